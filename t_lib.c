@@ -1,707 +1,3521 @@
 #include "t_lib.h"
 
-tQueue_t *running;
-tQueue_t *ready_high;
-tQueue_t *ready_low;
-tQueue_t *all;
+//Every live thread holds a slot; tids map to slots through tid_index
+threadSlot *slots = NULL;
+int nslots = 0;
+int free_slot = -1;
+tidEntry *tid_index = NULL;
+int tid_cap = 0;
+int tid_used = 0; // live and deleted entries
 
+//Time slice, and the period of the tick timer that measures it, in usec
 int timeout = 10000;
+int tick = 1000;
+
+//Time slice of each priority level in usec, 0 for timeout
+int level_quantum[PRIO_LEVELS];
+
+//Kernel worker threads, worker 0 is the thread that called t_init()
+worker_t *workers;
+int nworkers = 0;
+int shutting_down = 0;
+__thread worker_t *this_worker;
+
+//Guards all queues, semaphores and mailboxes, and is held across switches
+volatile int sched_lock = 0;
+
+//T_SCHED_FAIR weight of each priority level, filled in by t_init_workers()
+int fair_weights[PRIO_LEVELS];
+
+//Live T_SCHED_MLFQ threads, so aging is skipped when there are none
+int mlfq_threads = 0;
+
+//Live T_SCHED_EDF threads, so pickNext() skips the EDF heaps when there are none
+int edf_threads = 0;
+
+//Workers asleep in parkWorker(), so makeReady() wakes one only when needed
+volatile int nparked = 0;
+
+//Wait-for cycle detection from the tick: period in ns, 0 for off, when the
+//next check is due, and who hears of a cycle; findCycle() stamps its walks
+long long deadlock_period = 0;
+volatile long long deadlock_due = 0;
+void (*deadlock_report)(const int *tids, int n) = NULL;
+int deadlock_stamp = 0;
+
+//Switch straight to a thread woken by sem_signal() or send(), see t_set_handoff()
+int handoff = 0;
+
+//Free-list allocators for the library's own structures, indexed by SLAB_*
+slab_t slabs[SLAB_TYPES] = {
+  { .name = "tcb_t", .size = sizeof(tcb_t) },
+  { .name = "tcbCold", .size = sizeof(tcbCold) },
+  { .name = "sem_t", .size = sizeof(sem_t) },
+  { .name = "tQueue_t", .size = sizeof(tQueue_t) },
+  { .name = "mbox", .size = sizeof(mbox) },
+  { .name = "messageNode", .size = sizeof(messageNode) },
+};
+
+//Free thread stacks, linked through their lowest usable word
+void *stack_pool = NULL;
+int stack_pool_count = 0;
+
+#ifdef T_SWITCH_FAST
+//Register-only switch primitives, defined in assembly at the end of this file
+void t_ctx_switch(void **save_sp, void *new_sp);
+void t_ctx_jump(void *new_sp);
+void t_ctx_boot(void **save_sp, ucontext_t *uc);
+#endif
 
 void t_init() {
-  //Ignore alarms
-  sighold(SIGALRM);
+  //Single kernel thread, as before
+  t_init_workers(1);
+}
+
+void t_init_workers(int n) {
+  if(n < 1){
+    perror("Need at least 1 worker");
+    exit(EXIT_FAILURE);
+  }
+
+  //Initialize thread table
+  initThreadTable();
+
+  //Worker 0 is the calling kernel thread
+  nworkers = n;
+  shutting_down = 0;
+  workers = (worker_t *) calloc(n,sizeof(worker_t));
+  int i;
+
+  //Fair class weights, 1.25x per level either side of priority 1
+  fair_weights[0] = FAIR_WEIGHT_0 * 5 / 4;
+  for(i = 1; i < PRIO_LEVELS; i++){
+    fair_weights[i] = FAIR_WEIGHT_0;
+    if(i > 1){
+      fair_weights[i] = fair_weights[i-1] * 4 / 5;
+    }
+    if(fair_weights[i] < FAIR_WEIGHT_MIN){
+      fair_weights[i] = FAIR_WEIGHT_MIN;
+    }
+  }
+
+  for(i = 0; i < n; i++){
+    workers[i].id = i;
+    int l;
+    for(l = 0; l < PRIO_LEVELS; l++){
+      initDeque(&(workers[i].ready[l]));
+    }
+    workers[i].inbox = createQueue();
+    workers[i].zombies = createQueue();
+    initHeap(&(workers[i].fair));
+    initHeap(&(workers[i].edf));
+    workers[i].sleepers = createQueue();
+    workers[i].next_release = NO_RELEASE;
+  }
+  workers[0].pthread = pthread_self();
+  this_worker = &workers[0];
 
-  //Initialize queues
-  running = createQueue();
-  ready_high = createQueue();
-  ready_low = createQueue();
-  all = createQueue();
+  //Ignore alarms until set up
+  workers[0].preempt_off = 1;
 
-  //Create TCB for main thread
-  tcb_t *tmp = (tcb_t *) calloc(1,sizeof(tcb_t));
+  //Create TCB for main thread, which always stays on worker 0
+  tcb_t *tmp = (tcb_t *) slabAlloc(SLAB_TCB);
   tmp->thread_id = -1;
   tmp->thread_priority = 1;
-  mbox_create(&(tmp->mail));
-  tmp->thread_context = (ucontext_t *) calloc(1,sizeof(ucontext_t));
-  if (getcontext(tmp->thread_context) == -1) {
+  tmp->pinned_worker = 0;
+  tmp->cold = (tcbCold *) slabAlloc(SLAB_COLD);
+  tmp->cold->base_priority = 1;
+  mboxCreate(&(tmp->cold->mail));
+  if (getcontext(&(tmp->cold->context)) == -1) {
+    perror("getcontext");
+    exit(EXIT_FAILURE);
+  }
+
+  //Main thread is running on worker 0
+  addThread(tmp,0);
+  workers[0].current = tmp;
+
+  if(n > 1){
+    //Worker 0 needs its own stack to idle on when main blocks
+    tcb_t *idle = (tcb_t *) slabAlloc(SLAB_TCB);
+    idle->thread_id = -2;
+    idle->pinned_worker = 0;
+    idle->cold = (tcbCold *) slabAlloc(SLAB_COLD);
+    if (getcontext(&(idle->cold->context)) == -1) {
+      perror("getcontext");
+      exit(EXIT_FAILURE);
+    }
+    idle->cold->context.uc_stack.ss_sp = allocStack(STACK_SIZE);
+    idle->cold->context.uc_stack.ss_size = STACK_SIZE;
+    idle->cold->context.uc_stack.ss_flags = 0;
+    idle->cold->context.uc_link = NULL;
+    makecontext(&(idle->cold->context), idleStart, 0);
+    workers[0].idle = idle;
+  }
+
+  //Map a few stacks up front, so the first t_create() calls skip mmap()
+  warmStacks(STACK_POOL_WARM);
+
+  //Install the alarm handler and worker 0's tick timer before other workers run
+  init_alarm();
+
+  if(n > 1){
+    //Start the other workers, each in its own scheduler loop
+    for(i = 1; i < n; i++){
+      if(pthread_create(&(workers[i].pthread), NULL, workerMain, &workers[i]) != 0){
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  preemptOn();
+}
+
+void t_create(void (*fct)(int), int id, int pri) {
+  if(id < 0){
+    perror("ID must be > 0");
+    exit(EXIT_FAILURE);
+  }
+
+  //Default attributes, with the thread id passed to the function; these
+  //threads predate t_join(), so nobody joins them and they are detached
+  t_attr_t attr;
+  t_attr_init(&attr);
+  attr.thread_id = id;
+  attr.priority = pri;
+  attr.flags = T_DETACHED;
+
+  lockSched();
+  createThread(&attr, fct, NULL, NULL);
+  unlockSched();
+}
+
+int t_create_ex(void (*fct)(void *), void *arg, const t_attr_t *attr) {
+  //Defaults for anything not given; EDF threads need t_create_periodic()
+  t_attr_t defaults;
+  if(attr == NULL){
+    t_attr_init(&defaults);
+    attr = &defaults;
+  }
+  if(attr->policy == T_SCHED_EDF){
+    return -1;
+  }
+
+  lockSched();
+  int id = createThread(attr, NULL, fct, arg);
+  unlockSched();
+  return id;
+}
+
+void t_attr_init(t_attr_t *attr) {
+  //Automatic id, default priority, pooled stack size, no name
+  memset(attr,0,sizeof(t_attr_t));
+  attr->thread_id = -1;
+  attr->priority = 1;
+  attr->stack_size = STACK_SIZE;
+}
+
+int createThread(const t_attr_t *attr, void (*fct)(int), void (*entry)(void *), void *arg) {
+  if(workers == NULL || slots == NULL){
+    return -1;
+  }
+  if(attr->thread_id >= 0){
+    //An exited thread gives up its id to the new one, live ones cannot
+    tcb_t *old = findThread(attr->thread_id);
+    if(old != NULL && old->state != T_ZOMBIE){
+      perror("ID must be unique");
+      exit(EXIT_FAILURE);
+    }
+    if(old != NULL){
+      releaseZombie(old);
+    }
+  }
+
+  //Stacks are whole pages, and no smaller than STACK_MIN; growable ones
+  //reserve at least STACK_GROW_SIZE and commit pages as they are touched
+  size_t sz = attr->stack_size;
+  if((attr->flags & T_GROWABLE) && sz < STACK_GROW_SIZE){
+    sz = STACK_GROW_SIZE;
+  }
+  if(sz < STACK_MIN){
+    sz = STACK_MIN;
+  }
+  long page = sysconf(_SC_PAGESIZE);
+  sz = (sz + page - 1) & ~(page - 1);
+
+  //Allocate space for new thread and its cold block, with a handle for its
+  //id if none was given
+  tcb_t *tmp = (tcb_t *) slabAlloc(SLAB_TCB);
+  tmp->cold = (tcbCold *) slabAlloc(SLAB_COLD);
+  tmp->thread_id = attr->thread_id;
+  tmp->thread_priority = attr->priority;
+  tmp->cold->base_priority = attr->priority;
+  tmp->cold->thread_fn = fct;
+  tmp->cold->thread_entry = entry;
+  tmp->cold->thread_arg = arg;
+  tmp->pinned_worker = (attr->flags & T_PINNED) ? curWorker()->id : -1;
+  tmp->cold->detached = (attr->flags & T_DETACHED) != 0;
+  tmp->cold->group = attr->group;
+  tmp->policy = attr->policy;
+  if(tmp->policy == T_SCHED_MLFQ){
+    mlfq_threads++;
+  }
+  if(tmp->policy == T_SCHED_EDF){
+    //From t_create_periodic(), the argument is the thread's timing
+    tmp->cold->rt = (tPeriodic *) arg;
+    edf_threads++;
+  }
+
+  //A new fair thread starts level with the others, not ahead of them
+  tmp->cold->vruntime = curWorker()->fair_min;
+  if(attr->name != NULL){
+    strncpy(tmp->cold->name, attr->name, T_NAME_LEN-1);
+  }
+  mboxCreate(&(tmp->cold->mail));
+
+  if (getcontext(&(tmp->cold->context)) == -1) {
     perror("getcontext");
     exit(EXIT_FAILURE);
   }
 
-  //Add to running queue
-  addQueue(running,tmp);
-  addQueue(all,tmp);
-  
-  //Start scheduling alarms
-  init_alarm();
-  
-  sigrelse(SIGALRM);
+  //Create thread context, on a pooled stack for the default size
+  tmp->cold->context.uc_stack.ss_sp = allocStack(sz);
+  tmp->cold->context.uc_stack.ss_size = sz;
+  tmp->cold->context.uc_stack.ss_flags = 0;
+  tmp->cold->context.uc_link = NULL;
+  makecontext(&(tmp->cold->context), t_start, 0);
+
+  //Queue thread according to priority
+  addThread(tmp,attr->thread_id < 0);
+  if(attr->group != NULL){
+    //Members are joined by the group, never detached
+    tmp->cold->detached = 0;
+    groupAdd(attr->group,tmp->thread_id);
+  }
+  makeReady(tmp);
+  return tmp->thread_id;
+}
+
+void t_yield() {
+  //Give up the processor; a cancelled thread exits here
+  yieldThread();
+  testCancel();
+}
+
+void yieldThread() {
+  //Ignore alarms, the ready deques need no scheduler lock
+  preemptOff();
+
+  worker_t *w = curWorker();
+  if(w != NULL && w->current != w->idle){
+    tcb_t *tmp = w->current;
+    tcb_t *next;
+    if(tmp->policy == T_SCHED_EDF && !tmp->cold->rt->throttled){
+      //An EDF job with budget left only gives way to an earlier deadline,
+      //so only EDF jobs are taken, and one put back keeps its place by
+      //deadline; other classes keep their turn on their queues
+      if(w->next_release != NO_RELEASE){
+        releaseDue(w);
+      }
+      next = pickEdf(w);
+      if(next != NULL && edfKeeps(tmp,next)){
+        makeReady(next);
+        next = NULL;
+      }
+    }
+    else{
+      next = pickNext(w);
+    }
+
+    //Workers other than 0 drop back to their loop to exit
+    if(next == NULL && shutting_down && w->id != 0){
+      next = w->idle;
+    }
+
+    //Voluntary or not, the slice ends here; what is left may carry over
+    tmp->slice_used = carriedSlice(w,tmp);
+
+    if(next != NULL){
+      //Running thread goes back in the ready queue once switched off it
+      w->requeue = tmp;
+      switchTo(w, tmp, next);
+    }
+  }
+  preemptOn();
+}
+
+int t_yield_to(int tid) {
+  //Switch straight to a ready thread, which runs on the rest of our slice;
+  //-1 if it is not ready here, or cannot be switched to directly
+  lockSched();
+  tcb_t *tmp = findThread(tid);
+  int r = (tmp != NULL && handoffTo(curWorker(),tmp)) ? 0 : -1;
+  unlockSched();
+  return r;
+}
+
+void t_set_handoff(int on) {
+  //Whether sem_signal() and send() switch straight to the thread they wake
+  lockSched();
+  handoff = on;
+  unlockSched();
+}
+
+int handoffTo(worker_t *w, tcb_t *t) {
+  //Switch from the running thread to a ready one, which runs on what is
+  //left of its slice; the donor is requeued, and taken back first once t
+  //stops, if nothing better is ready. Round-robin threads on ready deques
+  //only, as claimThread() works on those; lock held, 0 if not switched
+  if(w == NULL || shutting_down){
+    return 0;
+  }
+  tcb_t *tmp = w->current;
+  if(tmp == w->idle || tmp == t || tmp->policy == T_SCHED_EDF){
+    return 0;
+  }
+  if(t->policy == T_SCHED_FAIR || t->policy == T_SCHED_EDF ||
+     (t->pinned_worker >= 0 && t->pinned_worker != w->id) || !claimThread(t)){
+    return 0;
+  }
+  t->slice_used = tmp->slice_used;
+  w->donor = tmp;
+  w->requeue = tmp;
+  w->unlock_pending = 1;
+  switchTo(w, tmp, t);
+  acquireSched();
+  return 1;
+}
+
+void handoffWoken(tcb_t *t) {
+  //In handoff mode, switch to a thread just woken, unless it would jump
+  //ahead of the running thread's level
+  worker_t *w = curWorker();
+  if(handoff && t != NULL && w != NULL && prioLevel(t) <= prioLevel(w->current)){
+    handoffTo(w,t);
+  }
+}
+
+void t_terminate() {
+  //Exit with no value
+  t_exit(NULL);
+}
+
+void t_exit(void *value) {
+  //Ignore alarms
+  lockSched();
+  exitThread(value);
+  unlockSched();
+}
+
+void exitThread(void *value) {
+  //End the running thread with the lock held; returns only if there is
+  //nothing else to switch to
+  worker_t *w = curWorker();
+  if(w != NULL){
+    tcb_t *tmp = w->current;
+
+    //Hand the exit value to any joiners first, they may be all that is left
+    tmp->cold->exit_value = value;
+    if(tmp->cold->exited != NULL){
+      while(tmp->cold->exited->count < 0){
+        semSignal(tmp->cold->exited);
+      }
+    }
+
+    //Queue next thread from ready queue, or idle if other workers may wake one
+    tcb_t *next = pickBlocking(w);
+    if(next == NULL && nworkers > 1){
+      next = w->idle;
+    }
+
+    if(next != NULL){
+      //Become a zombie until joined
+      tmp->state = T_ZOMBIE;
+      if(tmp->policy == T_SCHED_MLFQ){
+        mlfq_threads--;
+      }
+      if(tmp->policy == T_SCHED_EDF){
+        edf_threads--;
+      }
+      mboxDestroy(&(tmp->cold->mail));
+
+      //Mutexes it still holds are disowned, nobody inherits through a zombie
+      while(tmp->cold->held != NULL){
+        dropMutex(tmp->cold->held);
+      }
+
+      //Nobody may join a detached thread, so its id goes now
+      if(tmp->cold->detached){
+        removeThread(tmp);
+      }
+
+      //Its stack is freed by the reaper, once switched off it
+      addQueue(w->zombies,tmp);
+      w->nzombies++;
+      w->unlock_pending = 1;
+
+      //Switch to new running thread, ticking again if others now wait
+      chargeSwitch(w, NULL, next);
+      w->current = next;
+      if(!w->ticking && anyReady(w)){
+        wakeTick(w);
+      }
+      ctx_jump(next);
+    }
+  }
+}
+
+int t_join(int tid, void **value) {
+  //Wait for a thread to exit and take its exit value; -1 if there is no
+  //such thread, it is detached, or it is the caller
+  lockSched();
+
+  tcb_t *tmp = findThread(tid);
+  worker_t *w = curWorker();
+  if(tmp == NULL || tmp->cold->detached || (w != NULL && tmp == w->current)){
+    unlockSched();
+    return -1;
+  }
+
+  if(joinThread(tmp,value) < 0){
+    cancelExit();
+  }
+
+  //The last joiner out lets it be freed
+  if(tmp->cold->joiners == 0){
+    releaseZombie(tmp);
+  }
+  unlockSched();
+  return 0;
+}
+
+int joinThread(tcb_t *t, void **value) {
+  //Block until t exits, and take its exit value; joiners keep the zombie
+  //around until they wake. -1 if the caller was cancelled while waiting
+  if(t->state != T_ZOMBIE){
+    if(t->cold->exited == NULL){
+      semInit(&(t->cold->exited),0);
+    }
+    t->cold->joiners++;
+    int woken = semWaitFor(t->cold->exited,t->thread_id);
+    t->cold->joiners--;
+    if(woken < 0){
+      return -1;
+    }
+  }
+
+  if(value != NULL){
+    *value = t->cold->exit_value;
+  }
+  return 0;
+}
+
+void t_detach(int tid) {
+  //Nobody will join this thread, free it as soon as it exits
+  lockSched();
+  tcb_t *tmp = findThread(tid);
+  if(tmp != NULL && !tmp->cold->detached){
+    if(tmp->state == T_ZOMBIE){
+      releaseZombie(tmp);
+    }
+    else{
+      tmp->cold->detached = 1;
+    }
+  }
+  unlockSched();
+}
+
+int t_create_periodic(void (*fct)(void *), void *arg, long period, long budget, long deadline) {
+  //Periodic real-time thread: fct(arg) runs once every period usec, within
+  //budget usec of processor time, and should finish deadline usec after its
+  //release (0 for the end of the period); the first job is released now
+  if(period <= 0 || budget <= 0 || deadline < 0){
+    return -1;
+  }
+  tPeriodic *rt = (tPeriodic *) calloc(1,sizeof(tPeriodic));
+  rt->fn = fct;
+  rt->arg = arg;
+  rt->period = period * 1000LL;
+  rt->budget = budget * 1000LL;
+  rt->rel_deadline = (deadline > 0 ? deadline : period) * 1000LL;
+  rt->release = nowNs();
+  rt->deadline = rt->release + rt->rel_deadline;
+  rt->jobs = 1;
+
+  t_attr_t attr;
+  t_attr_init(&attr);
+  attr.policy = T_SCHED_EDF;
+  attr.priority = 0;
+  lockSched();
+  int id = createThread(&attr, NULL, periodicMain, rt);
+  unlockSched();
+  return id;
+}
+
+int t_periodic_stats(int tid, t_periodic_stats_t *st) {
+  //Job counts and release jitter of a periodic thread, -1 if it is not one
+  lockSched();
+  memset(st,0,sizeof(t_periodic_stats_t));
+  tcb_t *tmp = findThread(tid);
+  if(tmp == NULL || tmp->cold->rt == NULL){
+    unlockSched();
+    return -1;
+  }
+  tPeriodic *rt = tmp->cold->rt;
+  st->jobs = rt->jobs;
+  st->misses = rt->misses;
+  st->throttled = rt->throttles;
+  st->max_jitter = rt->jitter_max / 1000;
+  st->avg_jitter = rt->jobs > 0 ? rt->jitter_sum / rt->jobs / 1000 : 0;
+  unlockSched();
+  return 0;
+}
+
+void periodicMain(void *arg) {
+  //Body of a periodic thread: one job per release, until it exits or is
+  //cancelled
+  tPeriodic *rt = (tPeriodic *) arg;
+  for(;;){
+    //Jitter is how late the job starts after its release
+    long long late = nowNs() - rt->release;
+    if(late > rt->jitter_max){
+      rt->jitter_max = late;
+    }
+    rt->jitter_sum += late;
+
+    rt->fn(rt->arg);
+    waitPeriod();
+    testCancel();
+  }
+}
+
+void waitPeriod() {
+  //End the running job, and sleep until the next release
+  lockSched();
+  worker_t *w = curWorker();
+  tcb_t *tmp = w->current;
+  tPeriodic *rt = tmp->cold->rt;
+
+  //Finished late, unless already counted for running out of budget
+  long long now = nowNs();
+  if(now > rt->deadline && !rt->throttled){
+    rt->misses++;
+  }
+  rt->throttled = 0;
+  rt->release += rt->period;
+
+  //Pick who runs next before sleeping, as a release already due would make
+  //us ready to other workers while still on this stack
+  tcb_t *next = pickNext(w);
+  if(next == NULL && nworkers > 1){
+    next = w->idle;
+  }
+  sleepThread(w,tmp);
+
+  //A single worker with nothing ready waits for a release, maybe our own
+  if(next == NULL){
+    next = pickBlocking(w);
+  }
+  if(next != tmp){
+    w->unlock_pending = 1;
+    switchTo(w, tmp, next);
+    acquireSched();
+  }
+  unlockSched();
+}
+
+void t_cancel(int tid) {
+  //Make a thread exit with T_CANCELED at its next cancellation point
+  lockSched();
+  tcb_t *tmp = findThread(tid);
+  if(tmp != NULL){
+    cancelThread(tmp);
+  }
+  unlockSched();
+}
+
+int t_set_quantum(int tid, long usec) {
+  //Give one thread its own time slice, or back to its class's for 0
+  lockSched();
+  tcb_t *tmp = findThread(tid);
+  if(tmp == NULL || tmp->state == T_ZOMBIE){
+    unlockSched();
+    return -1;
+  }
+  tmp->quantum = (usec > 0) ? usecTicks(usec) : 0;
+  unlockSched();
+  return 0;
+}
+
+int t_set_carry(int tid, long usec) {
+  //Let a thread keep up to usec of slice it leaves unused, 0 for none
+  lockSched();
+  tcb_t *tmp = findThread(tid);
+  if(tmp == NULL || tmp->state == T_ZOMBIE){
+    unlockSched();
+    return -1;
+  }
+  tmp->carry = (usec > 0) ? usecTicks(usec) : 0;
+  unlockSched();
+  return 0;
+}
+
+void t_set_priority_quantum(int priority, long usec) {
+  //Time slice for round-robin threads at a priority, 0 for the default
+  lockSched();
+  if(priority < 0){
+    priority = 0;
+  }
+  if(priority >= PRIO_LEVELS){
+    priority = PRIO_LEVELS-1;
+  }
+  level_quantum[priority] = (usec > 0) ? usec : 0;
+  unlockSched();
+}
+
+void t_set_default_quantum(long usec) {
+  //Time slice for round-robin threads with nothing more specific
+  lockSched();
+  timeout = (usec > tick) ? usec : tick;
+  unlockSched();
+}
+
+void t_group_init(t_group_t **g) {
+  //Allocate an empty group
+  t_group_t *new_group = (t_group_t *) calloc(1,sizeof(t_group_t));
+  new_group->cap = 16;
+  new_group->tids = (int *) malloc(new_group->cap * sizeof(int));
+  *g = new_group;
+}
+
+int t_group_wait(t_group_t *g) {
+  //Join every member, then free them all at once instead of leaving their
+  //stacks to the reaper; returns how many were joined
+  lockSched();
+  int i, n = 0;
+  for(i = 0; i < g->count; i++){
+    tcb_t *tmp = findThread(g->tids[i]);
+    if(tmp == NULL || tmp->cold->group != g){
+      continue;
+    }
+    if(joinThread(tmp,NULL) < 0){
+      cancelExit();
+    }
+    if(tmp->cold->joiners == 0){
+      reapThread(tmp);
+      releaseZombie(tmp);
+    }
+    n++;
+  }
+  g->count = 0;
+  unlockSched();
+  return n;
+}
+
+int t_group_cancel(t_group_t *g) {
+  //Cancel every live member, pulling blocked ones out of their waits; does
+  //not wait for them, so a member may cancel its own group. Returns how
+  //many were cancelled
+  lockSched();
+  int i, n = 0;
+  for(i = 0; i < g->count; i++){
+    tcb_t *tmp = findThread(g->tids[i]);
+    if(tmp != NULL && tmp->cold->group == g && tmp->state == T_LIVE){
+      cancelThread(tmp);
+      n++;
+    }
+  }
+  unlockSched();
+  return n;
+}
+
+void t_group_destroy(t_group_t **g) {
+  //Members still running are detached, and freed as they exit
+  lockSched();
+  int i;
+  for(i = 0; i < (*g)->count; i++){
+    tcb_t *tmp = findThread((*g)->tids[i]);
+    if(tmp != NULL && tmp->cold->group == *g){
+      tmp->cold->group = NULL;
+      if(tmp->state == T_ZOMBIE){
+        releaseZombie(tmp);
+      }
+      else{
+        tmp->cold->detached = 1;
+      }
+    }
+  }
+  free((*g)->tids);
+  free(*g);
+  unlockSched();
+}
+
+void t_shutdown() {
+  //Ignore timer
+  lockSched();
+
+  if(workers != NULL){
+    timer_delete(workers[0].tick_timer);
+
+    //Stop the other workers, kicking any that are running a thread
+    int i;
+    if(nworkers > 1){
+      shutting_down = 1;
+      unlockSched();
+      for(i = 1; i < nworkers; i++){
+        wakeWorker(&workers[i]);
+        pthread_kill(workers[i].pthread, SIGALRM);
+        pthread_join(workers[i].pthread, NULL);
+      }
+      lockSched();
+      freeThread(workers[0].idle);
+    }
+
+    //Free the stacks of threads that exited, and any nobody can join
+    for(i = 0; i < nworkers; i++){
+      reapZombies(&workers[i]);
+    }
+  }
+
+  if(slots != NULL){
+    //Drop mailboxes and join semaphores before freeing any thread, as the
+    //senders and joiners they wake go back on the ready deques
+    int i;
+    for(i = 0; i < nslots; i++){
+      tcb_t *tmp = slots[i].tcb;
+      if(tmp != NULL && tmp->state != T_ZOMBIE){
+        mboxDestroy(&(tmp->cold->mail));
+      }
+      if(tmp != NULL && tmp->cold->exited != NULL){
+        semDestroy(&(tmp->cold->exited));
+        tmp->cold->exited = NULL;
+      }
+    }
+    for(i = 0; i < nslots; i++){
+      if(slots[i].tcb != NULL){
+        freeThread(slots[i].tcb);
+      }
+    }
+    freeThreadTable();
+  }
+
+  if(workers != NULL){
+    //Free ready deques, their threads were freed through the thread table
+    int i;
+    for(i = 0; i < nworkers; i++){
+      int l;
+      for(l = 0; l < PRIO_LEVELS; l++){
+        freeDeque(&(workers[i].ready[l]));
+      }
+      slabFree(SLAB_QUEUE,workers[i].inbox);
+      slabFree(SLAB_QUEUE,workers[i].zombies);
+      free(workers[i].fair.entries);
+      free(workers[i].edf.entries);
+      slabFree(SLAB_QUEUE,workers[i].sleepers);
+    }
+    free(workers);
+  }
+
+  //Unmap every pooled stack, now that all threads are gone, and release
+  //any slab nothing is still allocated from
+  drainStacks();
+  drainSlabs();
+
+  //Set queues to null, so fns can tell not initialized
+  workers = NULL;
+  nworkers = 0;
+  shutting_down = 0;
+  this_worker = NULL;
+  unlockSched();
+}
+
+void t_warm_stacks(int n) {
+  //Grow the stack pool to n free stacks ahead of a burst of t_create() calls
+  lockSched();
+  warmStacks(n);
+  unlockSched();
+}
+
+int t_stack_stats(int tid, t_stack_stats_t *st) {
+  //Reserved and committed stack bytes of one thread, -1 if there is no such thread
+  lockSched();
+  memset(st,0,sizeof(t_stack_stats_t));
+  tcb_t *tmp = findThread(tid);
+  if(tmp == NULL || tmp->state == T_ZOMBIE){
+    unlockSched();
+    return -1;
+  }
+  stackUsage(tmp->cold->context.uc_stack.ss_sp, tmp->cold->context.uc_stack.ss_size, st);
+  unlockSched();
+  return 0;
+}
+
+void t_stack_stats_total(t_stack_stats_t *st) {
+  //Reserved and committed stack bytes across all threads and the stack pool;
+  //high_water is the deepest of any one stack
+  lockSched();
+  memset(st,0,sizeof(t_stack_stats_t));
+  int i;
+  for(i = 0; i < nslots; i++){
+    tcb_t *tmp = slots[i].tcb;
+    if(tmp != NULL && tmp->state != T_ZOMBIE){
+      stackUsage(tmp->cold->context.uc_stack.ss_sp, tmp->cold->context.uc_stack.ss_size, st);
+    }
+  }
+  void *sp = stack_pool;
+  while(sp != NULL){
+    stackUsage(sp, STACK_SIZE, st);
+    sp = *(void **) sp;
+  }
+  unlockSched();
+}
+
+int t_slab_stats(t_slab_stats_t *st, int max) {
+  //Counters for each slab, up to max of them; returns how many were filled
+  lockSched();
+  int i;
+  for(i = 0; i < SLAB_TYPES && i < max; i++){
+    st[i].name = slabs[i].name;
+    st[i].allocs = slabs[i].allocs;
+    st[i].reused = slabs[i].reused;
+    st[i].live = slabs[i].live;
+    st[i].chunks = slabs[i].nchunks;
+  }
+  unlockSched();
+  return i;
+}
+
+int t_deadlock_check(int *tids, int max) {
+  //Look for a cycle of threads each blocked waiting on the next; returns its
+  //length, 0 for none, with up to max of its tids in wait order
+  lockSched();
+  int n = findCycle(tids,max,0);
+  unlockSched();
+  return n;
+}
+
+void t_deadlock_detect(long usec, void (*report)(const int *tids, int n)) {
+  //Check for wait-for cycles every usec, 0 to stop, passing each new one to
+  //report, or printing it for NULL. The tick only flags a check as due; it
+  //runs, report and all, on a thread leaving a library call, never in the
+  //signal handler, so report may use stdio but should not block
+  lockSched();
+  deadlock_report = (report != NULL) ? report : printCycle;
+  deadlock_period = (usec > 0) ? usec * 1000LL : 0;
+  deadlock_due = nowNs() + deadlock_period;
+  if(deadlock_period > 0 && curWorker() != NULL){
+    wakeTick(curWorker());
+  }
+  unlockSched();
+}
+
+void sem_init(sem_t **sp, int sem_count) {
+  //Ignore timer
+  lockSched();
+  semInit(sp,sem_count);
+  unlockSched();
+}
+
+void sem_init_ex(sem_t **sp, int sem_count, int order) {
+  //Ignore timer
+  lockSched();
+  semInit(sp,sem_count);
+  if(order == SEM_PRIO){
+    (*sp)->levels = (waitLevels *) calloc(1,sizeof(waitLevels));
+  }
+  unlockSched();
+}
+
+void sem_init_mutex(sem_t **sp) {
+  //Ignore timer; the best waiter is the one the holder inherits from, so it
+  //is also the one woken
+  lockSched();
+  semInit(sp,1);
+  (*sp)->mutex = 1;
+  (*sp)->levels = (waitLevels *) calloc(1,sizeof(waitLevels));
+  unlockSched();
+}
+
+void sem_wait(sem_t *sp) {
+  //Ignore timer
+  lockSched();
+  if(semWait(sp) < 0){
+    cancelExit();
+  }
+  unlockSched();
+}
+
+int sem_wait_all(sem_t **sems, int n) {
+  //A semaphore given twice would have us wait for a unit we already took,
+  //so refuse the set with -1 before taking any
+  int i, j;
+  for(i = 0; i < n; i++){
+    for(j = i + 1; j < n; j++){
+      if(sems[i] == sems[j]){
+        return -1;
+      }
+    }
+  }
+
+  //Ignore timer
+  lockSched();
+  if(semWaitAll(sems,n) < 0){
+    cancelExit();
+  }
+  unlockSched();
+  return 0;
+}
+
+void sem_wait_any(sem_t **sems, int n, int *index) {
+  //Ignore timer
+  lockSched();
+  if(semWaitAny(sems,n,index) < 0){
+    cancelExit();
+  }
+  unlockSched();
+}
+
+void sem_signal(sem_t *sp) {
+  //Ignore timer
+  lockSched();
+  handoffWoken(semSignal(sp));
+  unlockSched();
+}
+
+void sem_destroy(sem_t **sp){
+  //Ignore timer
+  lockSched();
+  semDestroy(sp);
+  unlockSched();
+}
+
+void semInit(sem_t **sp, int sem_count) {
+  //Allocate new semaphore with provided count
+  *sp = (sem_t *) slabAlloc(SLAB_SEM);
+  (*sp)->count = sem_count;
+  (*sp)->q = createQueue();
+  (*sp)->binary = (sem_count == 1);
+}
+
+int semWait(sem_t *sp) {
+  sp->count--;
+
+  //Block current thread and switch if counter goes negative
+  if(sp->count < 0){
+    worker_t *w = curWorker();
+    if(w != NULL){
+      tcb_t *tmp = w->current;
+
+      //A cancelled thread does not block, it is on its way out
+      if(tmp->state == T_CANCELING){
+        sp->count++;
+        return -1;
+      }
+
+      //Park current thread on the semaphore, lending our priority to a
+      //mutex's holder and on down its chain before picking who runs next
+      chargeBlock(w,tmp);
+      addWaiter(sp,tmp);
+      tmp->cold->waiting_on = sp;
+      if(sp->mutex && sp->owner != NULL && tmp->thread_priority < sp->owner->thread_priority){
+        inheritPriority(sp->owner);
+      }
+      blockThread(w,tmp);
+
+      //Woken by cancelThread() rather than a signal, which cleared this;
+      //a mutex was handed over by semSignal()
+      if(tmp->cold->waiting_on == NULL){
+        return -1;
+      }
+      tmp->cold->waiting_on = NULL;
+      tmp->cold->dl_reported = 0;
+    }
+  }
+  else if(sp->mutex && curWorker() != NULL){
+    takeMutex(sp,curWorker()->current);
+  }
+  else if(sp->binary && curWorker() != NULL){
+    sp->holder = curWorker()->current->thread_id;
+  }
+  return 0;
+}
+
+int semWaitFor(sem_t *sp, int tid) {
+  //semWait() on something only thread tid will signal, noting it as the
+  //blocked thread's wait-for edge for the deadlock detector
+  worker_t *w = curWorker();
+  if(w == NULL){
+    return semWait(sp);
+  }
+  tcb_t *self = w->current;
+  self->cold->wait_for = tid;
+  int woken = semWait(sp);
+  self->cold->wait_for = 0;
+  return woken;
+}
+
+int semWaitAll(sem_t **sems, int n) {
+  //Take every semaphore or none: block on one that is taken, and once it
+  //is ours take the rest if all are free, else give it back and block on
+  //the next taken one; never blocks holding any. -1 if cancelled
+  int held = -1;
+  for(;;){
+    int i, busy = -1;
+    for(i = 0; i < n && busy < 0; i++){
+      if(i != held && sems[i]->count <= 0){
+        busy = i;
+      }
+    }
+    if(busy < 0){
+      for(i = 0; i < n; i++){
+        if(i != held){
+          semWait(sems[i]);
+        }
+      }
+      return 0;
+    }
+    if(held >= 0){
+      semSignal(sems[held]);
+    }
+    held = busy;
+    if(semWait(sems[held]) < 0){
+      return -1;
+    }
+  }
+}
+
+int semWaitAny(sem_t **sems, int n, int *index) {
+  //Take the first semaphore that is free; with none, queue a T_PROXY
+  //stand-in for the calling thread on each, and block until semSignal()
+  //hands one over. -1 if cancelled
+  int i;
+  for(i = 0; i < n; i++){
+    if(sems[i]->count > 0){
+      *index = i;
+      return semWait(sems[i]);
+    }
+  }
+  worker_t *w = curWorker();
+  if(n <= 0 || w == NULL){
+    *index = -1;
+    return 0;
+  }
+  tcb_t *tmp = w->current;
+  if(tmp->state == T_CANCELING){
+    return -1;
+  }
+
+  //Stand-ins queue at our level, and share our cold part to find us by;
+  //holders of mutexes among them inherit from them as from any waiter
+  chargeBlock(w,tmp);
+  tcbCold *c = tmp->cold;
+  c->any = (tcb_t **) calloc(n,sizeof(tcb_t *));
+  c->any_sems = sems;
+  c->nany = n;
+  c->any_index = -1;
+  for(i = 0; i < n; i++){
+    tcb_t *p = (tcb_t *) slabAlloc(SLAB_TCB);
+    p->cold = c;
+    p->thread_id = tmp->thread_id;
+    p->thread_priority = tmp->thread_priority;
+    p->depth = tmp->depth;
+    p->pinned_worker = -1;
+    p->state = T_PROXY;
+    c->any[i] = p;
+    sems[i]->count--;
+    addWaiter(sems[i],p);
+    if(sems[i]->mutex && sems[i]->owner != NULL && p->thread_priority < sems[i]->owner->thread_priority){
+      inheritPriority(sems[i]->owner);
+    }
+  }
+  blockThread(w,tmp);
+
+  //Signalled, or cancelled, its stand-ins are off every queue by now
+  for(i = 0; i < n; i++){
+    slabFree(SLAB_TCB,c->any[i]);
+  }
+  free(c->any);
+  c->any = NULL;
+  c->dl_reported = 0;
+  if(c->any_index < 0){
+    return -1;
+  }
+  *index = c->any_index;
+  return 0;
+}
+
+tcb_t* wakeAny(tcb_t *p) {
+  //A stand-in was taken off its semaphore's queue: the thread it stands for
+  //has that semaphore, and the others get their places back
+  tcbCold *c = p->cold;
+  int i;
+  for(i = 0; i < c->nany; i++){
+    if(c->any[i] == p){
+      c->any_index = i;
+    }
+  }
+  dropProxies(c);
+  return slots[c->slot].tcb;
+}
+
+void dropProxies(tcbCold *c) {
+  //Unqueue a sem_wait_any() waiter's stand-ins still on a semaphore
+  int i;
+  for(i = 0; i < c->nany; i++){
+    sem_t *sp = c->any_sems[i];
+    if(c->any[i]->queue != NULL){
+      unlinkWaiter(sp,c->any[i]);
+      sp->count++;
+      if(sp->mutex && sp->owner != NULL){
+        inheritPriority(sp->owner);
+      }
+    }
+  }
+}
+
+void chargeBlock(worker_t *w, tcb_t *t) {
+  //Running thread is about to block: an MLFQ thread keeps its level, and
+  //it wakes to a fresh slice, plus what it kept of this one with a carry
+  int carried = carriedSlice(w,t);
+  if(t->policy == T_SCHED_MLFQ){
+    mlfqBlock(t);
+  }
+  t->slice_used = carried;
+}
+
+void blockThread(worker_t *w, tcb_t *t) {
+  //Switch away from the running thread, queued to wait, to the next ready
+  //one, or idle if other workers may wake it; the next thread drops the
+  //lock, and it is taken back once woken
+  tcb_t *next = pickBlocking(w);
+  if(next == NULL){
+    next = w->idle;
+  }
+  w->unlock_pending = 1;
+  switchTo(w, t, next);
+  acquireSched();
+}
+
+tcb_t* semSignal(sem_t *sp) {
+  //Returns the thread woken, if any
+  sp->count++;
+  if(sp->mutex){
+    dropMutex(sp);
+  }
+  sp->holder = 0;
+
+  //Move thread out of semaphore queue back into ready queues if count going positive
+  if(sp->count <= 0){
+    if(slots != NULL){
+      //Move next thread from semaphore queue into ready queue
+      tcb_t *tmp = rmWaiter(sp);
+      if(tmp != NULL && tmp->state == T_PROXY){
+        tmp = wakeAny(tmp);
+      }
+      if(tmp != NULL){
+        if(sp->mutex){
+          //A mutex goes straight to the waiter, which inherits from the rest
+          takeMutex(sp,tmp);
+          inheritPriority(tmp);
+        }
+        else if(sp->binary){
+          sp->holder = tmp->thread_id;
+        }
+        makeReady(tmp);
+        return tmp;
+      }
+    }
+  }
+  return NULL;
+}
+
+void takeMutex(sem_t *sp, tcb_t *t) {
+  //Record t as the mutex's owner, on its held list
+  sp->owner = t;
+  sp->next_held = t->cold->held;
+  t->cold->held = sp;
+}
+
+void dropMutex(sem_t *sp) {
+  //Take the mutex off its owner's held list, and give back what it inherited
+  tcb_t *t = sp->owner;
+  if(t == NULL){
+    return;
+  }
+  sem_t **m = &(t->cold->held);
+  while(*m != NULL && *m != sp){
+    m = &((*m)->next_held);
+  }
+  if(*m != NULL){
+    *m = sp->next_held;
+  }
+  sp->owner = NULL;
+  sp->next_held = NULL;
+  inheritPriority(t);
+}
+
+void inheritPriority(tcb_t *t) {
+  //Effective priority is the best of its own and those of every waiter on
+  //the mutexes it holds; a change moves it if ready, and passes on to the
+  //holder of a mutex it is blocked on
+  int p = t->cold->base_priority;
+  sem_t *m;
+  for(m = t->cold->held; m != NULL; m = m->next_held){
+    //Priority-ordered, the first waiter is the best
+    tcb_t *q;
+    for(q = queueHead(m->q); q != NULL; q = m->levels ? NULL : queueNext(m->q,q)){
+      if(q->thread_priority < p){
+        p = q->thread_priority;
+      }
+    }
+  }
+  if(p == t->thread_priority){
+    return;
+  }
+  t->thread_priority = p;
+
+  //Ready, it moves to its new level; blocked, it moves along a
+  //priority-ordered queue and passes the change on
+  if(requeueReady(curWorker(),t)){
+    return;
+  }
+  if(t->cold->any != NULL && t->cold->any_index < 0){
+    //In sem_wait_any(), each of its stand-ins does so in its place
+    int i;
+    for(i = 0; i < t->cold->nany; i++){
+      tcb_t *x = t->cold->any[i];
+      sem_t *s = t->cold->any_sems[i];
+      if(x == NULL || x->queue == NULL){
+        continue;
+      }
+      x->thread_priority = p;
+      if(s->levels != NULL){
+        unlinkWaiter(s,x);
+        addWaiter(s,x);
+      }
+      if(s->mutex && s->owner != NULL){
+        inheritPriority(s->owner);
+      }
+    }
+    return;
+  }
+  sem_t *sp = blockedOn(t);
+  if(sp != NULL && sp->levels != NULL){
+    unlinkWaiter(sp,t);
+    addWaiter(sp,t);
+  }
+  if(sp != NULL && sp->mutex && sp->owner != NULL){
+    inheritPriority(sp->owner);
+  }
+}
+
+sem_t* blockedOn(tcb_t *t) {
+  //waiting_on goes stale once signalled, so trust it only while the thread
+  //is still on a queue other than a pinned worker's inbox
+  sem_t *sp = t->cold->waiting_on;
+  tQueue_t *q = t->queue;
+  int in_inbox = t->pinned_worker >= 0 && q == workers[t->pinned_worker].inbox;
+  if(sp == NULL || q == NULL || in_inbox){
+    return NULL;
+  }
+  return sp;
+}
+
+void addWaiter(sem_t *sp, tcb_t *t) {
+  //Queue a thread on the semaphore: at the tail, or for SEM_PRIO after the
+  //last waiter on its own level or the nearest better one
+  waitLevels *wl = sp->levels;
+  if(wl == NULL){
+    addQueue(sp->q,t);
+    return;
+  }
+  int level = prioLevel(t);
+  unsigned long long better = wl->bits & (level == PRIO_LEVELS-1 ? ~0ULL : (2ULL << level) - 1);
+  tcb_t *after = NULL;
+  if(better != 0){
+    after = wl->tail[63 - __builtin_clzll(better)];
+  }
+  insertQueue(sp->q,after,t);
+  wl->tail[level] = t;
+  wl->bits |= 1ULL << level;
+  t->cold->wait_level = level;
+}
+
+tcb_t* rmWaiter(sem_t *sp) {
+  //Take the first waiter, or null if none
+  tcb_t *t = queueHead(sp->q);
+  if(t != NULL){
+    unlinkWaiter(sp,t);
+  }
+  return t;
+}
+
+void unlinkWaiter(sem_t *sp, tcb_t *t) {
+  //Remove a waiter from anywhere in the queue, keeping the level tails
+  waitLevels *wl = sp->levels;
+  if(wl != NULL){
+    int level = t->cold->wait_level;
+    if(wl->tail[level] == t){
+      tcb_t *prev = (t->link.prev == &(sp->q->head)) ? NULL : LINK_TCB(t->link.prev);
+      if(prev != NULL && prev->cold->wait_level == level){
+        wl->tail[level] = prev;
+      }
+      else{
+        wl->tail[level] = NULL;
+        wl->bits &= ~(1ULL << level);
+      }
+    }
+  }
+  unlinkQueue(sp->q,t);
+}
+
+void semDestroy(sem_t **sp){
+  if((*sp)->mutex){
+    dropMutex(*sp);
+  }
+
+  //Move all threads waiting on semaphore into ready queues
+  tcb_t *tmp;
+  while((tmp = rmWaiter(*sp)) != NULL){
+    if(tmp->state == T_PROXY){
+      tmp = wakeAny(tmp);
+    }
+    makeReady(tmp);
+  }
+
+  //Free semaphore memory allocations
+  free((*sp)->levels);
+  slabFree(SLAB_QUEUE,(*sp)->q);
+  slabFree(SLAB_SEM,*sp);
+}
+
+void mbox_create(mbox **mb){
+  //Ignore timer
+  lockSched();
+  mboxCreate(mb);
+  unlockSched();
+}
+
+void mbox_destroy(mbox **mb){
+  //Ignore timer
+  lockSched();
+  mboxDestroy(mb);
+  unlockSched();
+}
+
+void mboxCreate(mbox **mb){
+  //Allocate space for new mbox
+  mbox *new_mbox = (mbox *) slabAlloc(SLAB_MBOX);
+  new_mbox->msg = NULL;
+  semInit(&(new_mbox->mbox_send),1); //Allow sending
+  semInit(&(new_mbox->mbox_recv),0); //No messages yet
+  *mb = new_mbox;
+}
+
+void mboxDestroy(mbox **mb){
+  //Loop over messages and destroy all
+  messageNode *tmp = (*mb)->msg;
+  while(tmp != NULL){
+    messageNode *tmp2 = tmp;
+    tmp = tmp->next;
+    freeMessage(tmp2);
+  }
+
+  //Destroy semaphores and mailbox
+  semDestroy(&((*mb)->mbox_send));
+  semDestroy(&((*mb)->mbox_recv));
+  slabFree(SLAB_MBOX,*mb);
+}
+
+void mbox_deposit(mbox *mb, char *msg, int len){
+  //Ignore timer
+  lockSched();
+
+  //Allocate new messageNode, and append it to the mailbox
+  messageNode *new_msg = newMessage(msg,len,0);
+  if(appendMessage(mb,new_msg,NULL) < 0){
+    cancelExit();
+  }
+
+  unlockSched();
+}
+
+void mbox_withdraw(mbox *mb, char *msg, int *len){
+  //Ignore timer
+  lockSched();
+
+  //Get first message in mailbox
+  messageNode *head_msg = mb->msg;
+
+  if(head_msg == NULL){
+    //Mailbox is empty
+    *len = 0;
+  }
+  else{
+    //Transfer message attributes to arguments
+    strncpy(msg,head_msg->message,head_msg->len);
+    *len = head_msg->len-1;
+
+    //Remove message from list and destroy it
+    mb->msg = head_msg->next;
+    freeMessage(head_msg);
+  }
+  unlockSched();
+}
+
+messageNode* newMessage(char *msg, int len, int receiver){
+  //Allocate new messageNode from the running thread; short messages are
+  //copied into the node itself
+  messageNode *new_msg = (messageNode *) slabAlloc(SLAB_MESSAGE);
+  if(len+1 <= MSG_INLINE){
+    new_msg->message = new_msg->inline_msg;
+  }
+  else{
+    new_msg->message = calloc(len+1,sizeof(char));
+  }
+  strncpy(new_msg->message, msg, len+1);
+  new_msg->len = len+1;
+  new_msg->sender = curWorker()->current->thread_id;
+  new_msg->receiver = receiver;
+  semInit(&(new_msg->recv_wait),0);
+  new_msg->next = NULL;
+  return new_msg;
+}
+
+int appendMessage(mbox *mb, messageNode *new_msg, tcb_t **woken){
+  //Acquire lock on mailbox sending, dropping the message if cancelled;
+  //on success, woken is set to the receiver it woke, if any
+  if(semWait(mb->mbox_send) < 0){
+    freeMessage(new_msg);
+    return -1;
+  }
+
+  //Append message to mailbox
+  if(mb->msg == NULL){
+    mb->msg = new_msg;
+  }
+  else{
+    messageNode *head_msg = mb->msg;
+    while(head_msg->next != NULL){
+      head_msg = head_msg->next;
+    }
+    head_msg->next = new_msg;
+  }
+
+  //Release mailbox sending lock
+  semSignal(mb->mbox_send);
+
+  //Increase count of messages to be received
+  tcb_t *t = semSignal(mb->mbox_recv);
+  if(woken != NULL){
+    *woken = t;
+  }
+  return 0;
+}
+
+void freeMessage(messageNode *m){
+  //Release a blocked sender, then destroy the message
+  semSignal(m->recv_wait);
+  semDestroy(&(m->recv_wait));
+  if(m->message != m->inline_msg){
+    free(m->message);
+  }
+  slabFree(SLAB_MESSAGE,m);
+}
+
+void send(int tid, char *msg, int len){
+  //Ignore timer
+  lockSched();
+
+  //Find TCB of thread to send to
+  tcb_t *tmp = findThread(tid);
+  if(tmp == NULL || tmp->state == T_ZOMBIE){
+    unlockSched();
+    return;
+  }
+
+  //Allocate new messageNode, and append it to the mailbox
+  messageNode *new_msg = newMessage(msg,len,tid);
+  tcb_t *woken = NULL;
+  if(appendMessage(tmp->cold->mail,new_msg,&woken) < 0){
+    cancelExit();
+  }
+
+  //Switch only to a receiver the message woke, not one already ready
+  handoffWoken(woken);
+  unlockSched();
+}
+
+void receive(int *tid, char *msg, int *len){
+  //Ignore timer
+  lockSched();
+
+  //Mailbox of the calling thread, which may resume on another worker
+  mbox *mail = curWorker()->current->cold->mail;
+
+  //Wait for number of messages to be non-zero; the mailbox goes with a
+  //cancelled thread, so its counts need no repair
+  if(semWaitFor(mail->mbox_recv,*tid) < 0){
+    cancelExit();
+  }
+
+  //Loop over messages looking for a TID match
+  messageNode *tmp_msg = mail->msg;
+  if(tmp_msg == NULL){
+    //Shouldn't happen
+    *len = 0;
+  }
+  else{
+    //Prevent sending while receiving
+    if(semWait(mail->mbox_send) < 0){
+      cancelExit();
+    }
+
+    //Special case for first message in the list
+    if(*tid == 0 || *tid == tmp_msg->sender){
+      //Transfer message attributes to arguments
+      strncpy(msg,tmp_msg->message,tmp_msg->len);
+      *len = tmp_msg->len-1;
+      *tid = tmp_msg->sender;
+
+      //Remove message from list and destroy it
+      mail->msg = tmp_msg->next;
+      freeMessage(tmp_msg);
+    }
+    else{
+      //Loop over messages until TID match found
+      while(tmp_msg->next != NULL){
+        if(*tid == 0 || *tid == tmp_msg->next->sender){
+          //Transfer message attributes to arguments
+          strncpy(msg,tmp_msg->next->message,tmp_msg->next->len);
+          *len = tmp_msg->next->len-1;
+          *tid = tmp_msg->sender;
+
+          //Remove message from list and destroy it
+          messageNode *tmp_msg2 = tmp_msg->next;
+          tmp_msg->next = tmp_msg->next->next;
+          freeMessage(tmp_msg2);
+          break;
+        }
+        tmp_msg = tmp_msg->next;
+      }
+    }
+    //Allow sending to mailbox again
+    semSignal(mail->mbox_send);
+  }
+  //Decrement count of messages to be received
+  semSignal(mail->mbox_recv);
+
+  unlockSched();
+}
+
+void block_send(int tid, char *msg, int len){
+  //Ignore timer
+  lockSched();
+
+  //Find TCB of thread to send to
+  tcb_t *tmp = findThread(tid);
+  if(tmp == NULL || tmp->state == T_ZOMBIE){
+    unlockSched();
+    return;
+  }
+
+  //Allocate new messageNode, and append it to the mailbox
+  messageNode *new_msg = newMessage(msg,len,tid);
+  if(appendMessage(tmp->cold->mail,new_msg,NULL) < 0){
+    cancelExit();
+  }
+
+  //Wait for message to be received or destroyed; if cancelled, it stays
+  //queued and is freed by the receiver
+  if(semWaitFor(new_msg->recv_wait,tid) < 0){
+    cancelExit();
+  }
+
+  unlockSched();
+}
+
+void block_receive(int *tid, char *msg, int *len){
+  //standard receive already blocks
+  receive(tid,msg,len);
+}
+
+void sig_handler(int sig, siginfo_t *info, void *ctx) {
+  (void) sig;
+  (void) ctx;
+
+  //Not a worker yet, or already shut down
+  worker_t *w = curWorker();
+  if(w == NULL){
+    return;
+  }
+
+  //Flag the thread as inside the handler, even while switched off from
+  //here, so preemptOn() leaves deferred work for outside it
+  tcb_t *self = w->current;
+  self->cold->in_handler = 1;
+  handleTick(w,info);
+  self->cold->in_handler = 0;
+}
+
+void handleTick(worker_t *w, siginfo_t *info) {
+  //A tick from this worker's timer; a kick from pthread_kill() yields at once
+  if(info->si_code == SI_TIMER){
+    //Charge the tick to the running thread, preempt only once its slice is
+    //used; an MLFQ thread that used all of it sinks a level
+    tcb_t *tmp = w->current;
+    int expired = 0;
+    w->ticks++;
+    if(tmp != w->idle && tmp->policy == T_SCHED_EDF){
+      //An EDF job runs until it finishes, unless it overruns its budget
+      tPeriodic *rt = tmp->cold->rt;
+      rt->used++;
+      if(!rt->throttled && (long long) rt->used * tick * 1000 >= rt->budget){
+        rt->throttled = 1;
+        rt->throttles++;
+        rt->misses++;
+        expired = 1;
+      }
+    }
+    else if(tmp != w->idle){
+      tmp->slice_used++;
+      expired = tmp->slice_used >= sliceTicks(w,tmp);
+      if(expired && tmp->policy == T_SCHED_MLFQ && tmp->depth < MLFQ_DEPTH-1){
+        tmp->depth++;
+      }
+    }
+
+    //A periodic thread is due, switch so pickNext() releases it
+    if(w->next_release != NO_RELEASE && nowNs() >= w->next_release){
+      expired = 1;
+    }
+
+    //A deadlock check is due; it runs as the thread leaves its next library
+    //call, as it takes the lock and calls back into the application
+    if(deadlock_period > 0 && tmp != w->idle && nowNs() >= deadlock_due){
+      w->deadlock_pending = 1;
+    }
+
+    //Nothing else to run, stop ticking until a thread is made ready; only
+    //outside no-preemption sections, as the check takes the inbox lock. A
+    //running thread keeps the tick for deadlock checks
+    if(w->preempt_off == 0 && !anyReady(w) && (deadlock_period == 0 || tmp == w->idle)){
+      stopTick(w);
+      return;
+    }
+    if(!expired){
+      return;
+    }
+  }
+
+  //Inside a no-preemption section, yield when it ends instead
+  if(w->preempt_off > 0){
+    w->preempt_pending = 1;
+    return;
+  }
+
+  //If SIGALRM received, force current running thread to yield; never a
+  //cancellation point, the thread may be anywhere
+  yieldThread();
+}
+
+void t_start() {
+  //Entered from a switch with preemption off
+  finishSwitch();
+  tcb_t *self = curWorker()->current;
+  preemptOn();
+
+  //Run the thread body, unless cancelled before it started, and clean up
+  //if it returns without terminating
+  testCancel();
+  if(self->cold->thread_entry != NULL){
+    self->cold->thread_entry(self->cold->thread_arg);
+  }
+  else{
+    self->cold->thread_fn(self->thread_id);
+  }
+  t_terminate();
+}
+
+void ctx_switch(tcb_t *from, tcb_t *to) {
+#ifdef T_SWITCH_FAST
+  if(to->saved_sp != NULL){
+    //Save callee-saved registers on this stack, and resume the other one
+    t_ctx_switch(&(from->saved_sp), to->saved_sp);
+  }
+  else{
+    //First run of a thread, enter through its makecontext() state
+    t_ctx_boot(&(from->saved_sp), &(to->cold->context));
+  }
+#else
+  swapcontext(&(from->cold->context), &(to->cold->context));
+#endif
+}
+
+void ctx_jump(tcb_t *to) {
+#ifdef T_SWITCH_FAST
+  if(to->saved_sp != NULL){
+    t_ctx_jump(to->saved_sp);
+  }
+#endif
+  setcontext(&(to->cold->context));
+}
+
+void init_alarm() {
+  //Install the alarm handler, and start ticking on this worker
+  struct sigaction sa;
+  memset(&sa,0,sizeof(sa));
+  sa.sa_sigaction = sig_handler;
+  sa.sa_flags = SA_SIGINFO | SA_NODEFER; //a switch out of the handler must not leave SIGALRM blocked
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGALRM,&sa,NULL);
+  initTick(curWorker());
+}
+
+void initTick(worker_t *w) {
+  //Periodic timer signalling only the calling kernel thread, started tickless
+  struct sigevent sev;
+  memset(&sev,0,sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGALRM;
+  sev._sigev_un._tid = syscall(SYS_gettid);
+  if(timer_create(CLOCK_MONOTONIC,&sev,&(w->tick_timer)) == -1){
+    perror("timer_create");
+    exit(EXIT_FAILURE);
+  }
+  w->ticking = 0;
+}
+
+void setTick(worker_t *w, long usec) {
+  //Arm the tick timer with the given period, or disarm it with 0
+  struct itimerspec its;
+  its.it_value.tv_sec = usec / 1000000;
+  its.it_value.tv_nsec = (usec % 1000000) * 1000;
+  its.it_interval = its.it_value;
+  timer_settime(w->tick_timer,0,&its,NULL);
+}
+
+void stopTick(worker_t *w) {
+  //Go tickless; disarm before clearing the flag, so a racing wakeTick() rearms
+  setTick(w,0);
+  __atomic_store_n(&(w->ticking),0,__ATOMIC_SEQ_CST);
+
+  //A thread made ready meanwhile may have seen the flag still set
+  if(anyReady(w)){
+    wakeTick(w);
+  }
+}
+
+void wakeTick(worker_t *w) {
+  //Restart a tickless worker's timer, now there is a thread to preempt for
+  if(!__atomic_load_n(&(w->ticking),__ATOMIC_SEQ_CST) &&
+     !__atomic_exchange_n(&(w->ticking),1,__ATOMIC_SEQ_CST)){
+    setTick(w,tick);
+  }
+}
+
+int anyReady(worker_t *w) {
+  //Whether this worker could switch to anything now, or once its periodic
+  //threads waiting for release are due, which needs the tick to wake them
+  return w->next_release != NO_RELEASE || anyRunnable(w);
+}
+
+int anyRunnable(worker_t *w) {
+  //Whether this worker could switch to anything now: its own deques, its
+  //inbox, or another worker's deques and heaps
+  if(readyLevel(w) < PRIO_LEVELS || inboxLevel(w) < PRIO_LEVELS){
+    return 1;
+  }
+  int i;
+  for(i = 0; i < nworkers; i++){
+    worker_t *v = &workers[i];
+    if(readyLevel(v) < PRIO_LEVELS || v->fair.count > 0 || v->edf.count > 0){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void preemptOff() {
+  //Count nested no-preemption sections on this worker, no syscalls needed
+  worker_t *w = curWorker();
+  while(w != NULL){
+    __atomic_add_fetch(&(w->preempt_off),1,__ATOMIC_SEQ_CST);
+    worker_t *now = curWorker();
+    if(now == w){
+      return;
+    }
+    //Preempted onto another worker before the count went up, undo and retry
+    __atomic_sub_fetch(&(w->preempt_off),1,__ATOMIC_SEQ_CST);
+    w = now;
+  }
+}
+
+void preemptOn() {
+  //Leave a no-preemption section, taking any yield deferred by the handler,
+  //and then a deadlock check the tick found due, unless still inside it
+  worker_t *w = curWorker();
+  if(w != NULL){
+    int check = 0;
+    if(w->deadlock_pending && w->preempt_off == 1 && !w->current->cold->in_handler){
+      w->deadlock_pending = 0;
+      check = 1;
+    }
+    if(__atomic_sub_fetch(&(w->preempt_off),1,__ATOMIC_SEQ_CST) == 0 && w->preempt_pending){
+      w->preempt_pending = 0;
+      yieldThread();
+    }
+    if(check){
+      checkDeadlocks();
+    }
+  }
+}
+
+void lockSched() {
+  //Ignore alarms on this worker, then spin for the scheduler lock
+  preemptOff();
+  acquireSched();
+}
+
+void unlockSched() {
+  releaseSched();
+  preemptOn();
+}
+
+void acquireSched() {
+  while(__atomic_exchange_n(&sched_lock,1,__ATOMIC_ACQUIRE)){
+    while(__atomic_load_n(&sched_lock,__ATOMIC_RELAXED)){
+      sched_yield();
+    }
+  }
+}
+
+void releaseSched() {
+  __atomic_store_n(&sched_lock,0,__ATOMIC_RELEASE);
+}
+
+__attribute__((noinline)) worker_t* curWorker() {
+  //Kept out of line, so the TLS read is redone after a thread changes worker
+  __asm__ __volatile__("" ::: "memory");
+  return this_worker;
+}
+
+tcb_t* pickNext(worker_t *w) {
+  //Other workers stop taking threads once shutdown begins
+  if(shutting_down && w->id != 0){
+    return NULL;
+  }
+
+  //Raise MLFQ threads that have waited too long, at most once a tick
+  if(mlfq_threads > 0 && w->ticks != w->aged_at){
+    w->aged_at = w->ticks;
+    ageLevels(w);
+  }
+
+  //Released EDF jobs come first, earliest deadline first
+  if(edf_threads > 0){
+    if(w->next_release != NO_RELEASE){
+      releaseDue(w);
+    }
+    tcb_t *tmp = pickEdf(w);
+    if(tmp != NULL){
+      return tmp;
+    }
+  }
+
+  //A thread that handed its slice to the one stopping now runs on with the
+  //rest of it, unless it is spent or a better level is ready
+  if(w->donor != NULL){
+    tcb_t *d = w->donor;
+    tcb_t *cur = w->current;
+    w->donor = NULL;
+    int spent = cur != w->idle && cur->slice_used >= sliceTicks(w,cur);
+    int here = d->pinned_worker < 0 || d->pinned_worker == w->id;
+    if(!spent && here && prioLevel(d) <= readyLevel(w) && claimThread(d)){
+      d->slice_used = (cur != w->idle) ? cur->slice_used : 0;
+      return d;
+    }
+  }
+
+  for(;;){
+    //Highest level ready on this worker, its inbox, or another worker
+    int best = readyLevel(w);
+    worker_t *from = w;
+    int level = inboxLevel(w);
+    if(level < best){
+      best = level;
+      from = NULL;
+    }
+    int i;
+    for(i = 1; i < nworkers; i++){
+      worker_t *v = &workers[(w->id + i) % nworkers];
+      level = readyLevel(v);
+      if(level < best){
+        best = level;
+        from = v;
+      }
+    }
+    if(best >= PRIO_LEVELS){
+      //No round-robin thread anywhere, try the fair class
+      return pickFair(w);
+    }
+
+    tcb_t *tmp;
+    if(from == NULL){
+      tmp = takeInbox(w,best);
+    }
+    else{
+      tmp = takeLevel(from,best);
+    }
+
+    if(tmp != NULL && tmp->pinned_worker >= 0 && tmp->pinned_worker != w->id){
+      //Stole a pinned thread, pass it on to its own worker
+      makeReady(tmp);
+    }
+    else if(tmp != NULL){
+      return tmp;
+    }
+    //Otherwise lost a race for it, look again
+  }
+}
+
+tcb_t* pickFair(worker_t *w) {
+  //Lowest virtual runtime on this worker, or else stolen from another
+  tcb_t *tmp = takeFair(w,w);
+  int i;
+  for(i = 1; tmp == NULL && i < nworkers; i++){
+    tmp = takeFair(&workers[(w->id + i) % nworkers],w);
+    if(tmp != NULL && tmp->pinned_worker >= 0 && tmp->pinned_worker != w->id){
+      //Stole a pinned thread, pass it on to its own worker
+      makeReady(tmp);
+      tmp = NULL;
+    }
+  }
+  return tmp;
+}
+
+tcb_t* takeFair(worker_t *from, worker_t *into) {
+  //Pop the root of a worker's fair heap, for running on into
+  if(from->fair.count == 0){
+    return NULL;
+  }
+  lockHeap(&(from->fair));
+  if(from->fair.count == 0){
+    unlockHeap(&(from->fair));
+    return NULL;
+  }
+  heapEntry top = popHeap(&(from->fair));
+
+  //The floor only moves forward, as the smallest vruntime run here
+  if(top.key > from->fair_min){
+    from->fair_min = top.key;
+  }
+  long long base = from->fair_min;
+  unlockHeap(&(from->fair));
+
+  //Moving workers keeps its lead or lag relative to the new worker's floor
+  if(into != from){
+    top.t->cold->vruntime += into->fair_min - base;
+  }
+  return top.t;
+}
+
+void pushFair(worker_t *w, tcb_t *t) {
+  //Insert into this worker's fair heap; a thread back from sleeping keeps
+  //only FAIR_SLEEPER_CREDIT of lead, so it cannot hog the processor
+  lockHeap(&(w->fair));
+  long long v = t->cold->vruntime;
+  if(v < w->fair_min - FAIR_SLEEPER_CREDIT){
+    v = w->fair_min - FAIR_SLEEPER_CREDIT;
+    t->cold->vruntime = v;
+  }
+  pushHeap(&(w->fair),v,t);
+  unlockHeap(&(w->fair));
+
+  //Well behind the fair thread doing the wakeup, it preempts at the next tick
+  tcb_t *cur = w->current;
+  if(cur != t && cur->policy == T_SCHED_FAIR && v + FAIR_WAKEUP_GRAN < cur->cold->vruntime){
+    cur->slice_used = sliceTicks(w,cur);
+  }
+}
+
+int sliceTicks(worker_t *w, tcb_t *t) {
+  //Ticks a thread may run before preemption: its own quantum if set, doubled
+  //per level of depth for MLFQ; otherwise for an MLFQ thread the quantum of
+  //its depth, for a fair thread its share of FAIR_LATENCY among those
+  //waiting here, and for the rest the slice of their priority level. An
+  //MLFQ thread aged above its priority gets the depth 0 slice
+  int sunk = (t->depth > 0) ? t->depth : 0;
+  if(t->quantum > 0){
+    int q = (t->policy == T_SCHED_MLFQ) ? t->quantum << sunk : t->quantum;
+    return (q < SHRT_MAX) ? q : SHRT_MAX - 1;
+  }
+  if(t->policy == T_SCHED_MLFQ){
+    return ((MLFQ_QUANTUM << sunk) + tick - 1) / tick;
+  }
+  if(t->policy != T_SCHED_FAIR){
+    int usec = level_quantum[prioLevel(t)];
+    if(usec == 0){
+      usec = timeout;
+    }
+    return usecTicks(usec);
+  }
+  int usec = FAIR_LATENCY / (w->fair.count + 1);
+  if(usec < FAIR_MIN_SLICE){
+    usec = FAIR_MIN_SLICE;
+  }
+  return (usec + tick - 1) / tick;
+}
+
+int carriedSlice(worker_t *w, tcb_t *t) {
+  //Leaving the processor before its slice is up, a thread with a carry cap
+  //keeps what it did not use, up to the cap, as a negative slice_used
+  if(t->carry == 0){
+    return 0;
+  }
+  int left = sliceTicks(w,t) - t->slice_used;
+  if(left <= 0){
+    return 0;
+  }
+  return -((left < t->carry) ? left : t->carry);
+}
+
+short usecTicks(long usec) {
+  //Whole ticks, rounded up, that fit a tick count in a short
+  long n = (usec + tick - 1) / tick;
+  if(n < 1){
+    n = 1;
+  }
+  return (n < SHRT_MAX) ? (short) n : SHRT_MAX - 1;
+}
+
+void ageLevels(worker_t *w) {
+  //Raise the oldest MLFQ threads on each of this worker's levels by one
+  //level once they have waited MLFQ_AGE there, past their own priority if
+  //need be, up to level 0; a whole slice used sinks them back a level
+  long age = (MLFQ_AGE + tick - 1) / tick;
+  unsigned long long bits = __atomic_load_n(&(w->ready_bits),__ATOMIC_ACQUIRE) & ~1ULL;
+  while(bits != 0){
+    int level = __builtin_ctzll(bits);
+    bits &= bits - 1;
+    tDeque_t *d = &(w->ready[level]);
+    for(;;){
+      //Peek at the oldest first, so threads that stay are not reordered
+      long tp = __atomic_load_n(&(d->top),__ATOMIC_ACQUIRE);
+      if(tp >= __atomic_load_n(&(d->bottom),__ATOMIC_ACQUIRE)){
+        break;
+      }
+      dequeArray *a = __atomic_load_n(&(d->array),__ATOMIC_ACQUIRE);
+      tcb_t *e = __atomic_load_n(&(a->buf[tp % a->size]),__ATOMIC_RELAXED);
+      tcb_t *tmp = READY_TCB(e);
+      int stale = !(tmp->ready_gen & 1) || (tmp->ready_gen & READY_TAG) != ((uintptr_t) e & READY_TAG);
+      if(!stale && (tmp->policy != T_SCHED_MLFQ || w->ticks - tmp->cold->ready_tick < age)){
+        break;
+      }
+
+      //A thief may beat us to it; whatever we take goes back ready, and
+      //stale entries are dropped
+      tmp = stealDeque(d);
+      if(tmp == NULL){
+        break;
+      }
+      tmp = claimReady(tmp);
+      if(tmp == NULL){
+        continue;
+      }
+      if(tmp->policy == T_SCHED_MLFQ && tmp->depth > -tmp->thread_priority){
+        tmp->depth--;
+      }
+      makeReady(tmp);
+    }
+  }
+}
+
+void mlfqBlock(tcb_t *t) {
+  //Blocking before the slice is used up raises an MLFQ thread a level, and
+  //it starts a fresh slice when woken
+  if(t->slice_used < sliceTicks(curWorker(),t) && t->depth > 0){
+    t->depth--;
+  }
+  t->slice_used = 0;
+}
+
+tcb_t* pickEdf(worker_t *w) {
+  //Earliest deadline on this worker, or else taken from another
+  int i;
+  for(i = 0; i < nworkers; i++){
+    worker_t *v = &workers[(w->id + i) % nworkers];
+    if(v->edf.count == 0){
+      continue;
+    }
+    lockHeap(&(v->edf));
+    tcb_t *tmp = NULL;
+    if(v->edf.count > 0){
+      tmp = popHeap(&(v->edf)).t;
+    }
+    unlockHeap(&(v->edf));
+    if(tmp != NULL && tmp->pinned_worker >= 0 && tmp->pinned_worker != w->id){
+      //Took a pinned thread, pass it on to its own worker
+      makeReady(tmp);
+    }
+    else if(tmp != NULL){
+      return tmp;
+    }
+  }
+  return NULL;
+}
+
+tcb_t* pickBlocking(worker_t *w) {
+  //Next thread for a caller about to block; with a single worker and only
+  //periodic threads waiting for release, sleep until the first is due. With
+  //none, a thread left waiting is deadlocked, and otherwise NULL is returned
+  tcb_t *next = pickNext(w);
+  while(next == NULL && nworkers == 1){
+    if(w->next_release == NO_RELEASE){
+      //Deadlock only if some thread still waits, not when the last exits
+      if(anyBlocked()){
+        deadlocked();
+      }
+      return NULL;
+    }
+    struct timespec ts;
+    ts.tv_sec = w->next_release / 1000000000LL;
+    ts.tv_nsec = w->next_release % 1000000000LL;
+    clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL);
+    next = pickNext(w);
+  }
+  return next;
+}
+
+void releaseDue(worker_t *w) {
+  //Make ready every sleeping EDF thread whose release time has come, with
+  //a fresh budget and deadline; only the owning worker touches sleepers
+  long long now = nowNs();
+  tcb_t *tmp;
+  while((tmp = queueHead(w->sleepers)) != NULL && tmp->cold->rt->release <= now){
+    tPeriodic *rt = tmp->cold->rt;
+    unlinkQueue(w->sleepers,tmp);
+    if(!rt->throttled){
+      rt->jobs++;
+    }
+    rt->throttled = 0;
+    rt->used = 0;
+    rt->deadline = rt->release + rt->rel_deadline;
+    makeReady(tmp);
+  }
+  tmp = queueHead(w->sleepers);
+  w->next_release = tmp != NULL ? tmp->cold->rt->release : NO_RELEASE;
+}
+
+void sleepThread(worker_t *w, tcb_t *t) {
+  //Queue an EDF thread until its release time, keeping sleepers in order:
+  //after the last one released no later than it
+  tcb_t *after = NULL, *iter = queueHead(w->sleepers);
+  while(iter != NULL && iter->cold->rt->release <= t->cold->rt->release){
+    after = iter;
+    iter = queueNext(w->sleepers,iter);
+  }
+  insertQueue(w->sleepers,after,t);
+  w->next_release = queueHead(w->sleepers)->cold->rt->release;
+  wakeTick(w);
+}
+
+int edfKeeps(tcb_t *cur, tcb_t *next) {
+  //Whether a running EDF job with budget left should keep the processor
+  //rather than switch to next
+  if(cur->cold->rt->throttled){
+    return 0;
+  }
+  return next->policy != T_SCHED_EDF || next->cold->rt->deadline > cur->cold->rt->deadline;
+}
+
+int fairWeight(tcb_t *t) {
+  //Weight of a fair thread at its priority level
+  return fair_weights[prioLevel(t)];
+}
+
+void chargeSwitch(worker_t *w, tcb_t *from, tcb_t *to) {
+  //Charge the fair thread being switched off for its run, scaled by its
+  //weight, and note when the one switched to starts; no clock otherwise
+  if((from == NULL || from->policy != T_SCHED_FAIR) && to->policy != T_SCHED_FAIR){
+    return;
+  }
+  long long now = nowNs();
+  if(from != NULL && from->policy == T_SCHED_FAIR){
+    from->cold->vruntime += (now - w->run_start) * FAIR_WEIGHT_0 / fairWeight(from);
+  }
+  w->run_start = now;
+}
+
+long long nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+tcb_t* takeLevel(worker_t *w, int level) {
+  //Take the oldest thread on one level of a worker's deques
+  tDeque_t *d = &(w->ready[level]);
+  for(;;){
+    tcb_t *tmp = stealDeque(d);
+    if(tmp == NULL){
+      //Empty, clear its bit; set it again if a push raced with us
+      unsigned long long bit = 1ULL << level;
+      __atomic_fetch_and(&(w->ready_bits),~bit,__ATOMIC_SEQ_CST);
+      if(__atomic_load_n(&(d->top),__ATOMIC_SEQ_CST) < __atomic_load_n(&(d->bottom),__ATOMIC_SEQ_CST)){
+        __atomic_fetch_or(&(w->ready_bits),bit,__ATOMIC_SEQ_CST);
+      }
+      return NULL;
+    }
+    tmp = claimReady(tmp);
+    if(tmp != NULL){
+      return tmp;
+    }
+  }
+}
+
+int readyLevel(worker_t *w) {
+  //Find-first-set on the ready bitmap, PRIO_LEVELS when nothing is ready
+  unsigned long long bits = __atomic_load_n(&(w->ready_bits),__ATOMIC_ACQUIRE);
+  if(bits == 0){
+    return PRIO_LEVELS;
+  }
+  return __builtin_ctzll(bits);
+}
+
+int inboxLevel(worker_t *w) {
+  //Highest level among threads other workers queued for this one
+  if(__atomic_load_n(&(w->inbox->head.next),__ATOMIC_ACQUIRE) == &(w->inbox->head)){
+    return PRIO_LEVELS;
+  }
+  int best = PRIO_LEVELS;
+  while(__atomic_exchange_n(&(w->inbox_lock),1,__ATOMIC_ACQUIRE)){
+    sched_yield();
+  }
+  tcb_t *tmp = queueHead(w->inbox);
+  while(tmp != NULL){
+    if(prioLevel(tmp) < best){
+      best = prioLevel(tmp);
+    }
+    tmp = queueNext(w->inbox,tmp);
+  }
+  __atomic_store_n(&(w->inbox_lock),0,__ATOMIC_RELEASE);
+  return best;
+}
+
+tcb_t* takeInbox(worker_t *w, int level) {
+  //Take the first inbox thread on the given level
+  while(__atomic_exchange_n(&(w->inbox_lock),1,__ATOMIC_ACQUIRE)){
+    sched_yield();
+  }
+  tcb_t *tmp = queueHead(w->inbox);
+  while(tmp != NULL && prioLevel(tmp) != level){
+    tmp = queueNext(w->inbox,tmp);
+  }
+  if(tmp != NULL){
+    unlinkQueue(w->inbox,tmp);
+  }
+  __atomic_store_n(&(w->inbox_lock),0,__ATOMIC_RELEASE);
+  return tmp;
+}
+
+void makeReady(tcb_t *t) {
+  //Queue thread according to priority, on the worker doing the wakeup
+  worker_t *w = curWorker();
+  if(t->pinned_worker >= 0 && t->pinned_worker != w->id){
+    //Pinned elsewhere, hand it to that worker
+    worker_t *p = &workers[t->pinned_worker];
+    while(__atomic_exchange_n(&(p->inbox_lock),1,__ATOMIC_ACQUIRE)){
+      sched_yield();
+    }
+    addQueue(p->inbox,t);
+    __atomic_store_n(&(p->inbox_lock),0,__ATOMIC_RELEASE);
+    wakeTick(p);
+    wakeWorker(p);
+  }
+  else if(t->policy == T_SCHED_FAIR){
+    //Into this worker's fair heap, by virtual runtime
+    pushFair(w,t);
+    wakeTick(w);
+    wakeParked(w);
+  }
+  else if(t->policy == T_SCHED_EDF && t->cold->rt->throttled){
+    //Out of budget, the job carries on from its next period
+    t->cold->rt->release += t->cold->rt->period;
+    sleepThread(w,t);
+  }
+  else if(t->policy == T_SCHED_EDF){
+    //Into this worker's EDF heap, by deadline
+    lockHeap(&(w->edf));
+    pushHeap(&(w->edf),t->cold->rt->deadline,t);
+    unlockHeap(&(w->edf));
+    wakeTick(w);
+    wakeParked(w);
+  }
+  else{
+    //Push, then mark the level so pickers see it
+    if(t->policy == T_SCHED_MLFQ){
+      t->cold->ready_tick = w->ticks;
+    }
+    pushReady(w,t);
+    wakeParked(w);
+  }
+}
+
+void pushReady(worker_t *w, tcb_t *t) {
+  //Push a thread on no ready deque under a new odd ready_gen, kept in the
+  //entry's low bits; nobody else changes an even ready_gen
+  unsigned short g = __atomic_load_n(&(t->ready_gen),__ATOMIC_RELAXED) + 1;
+  __atomic_store_n(&(t->ready_gen),g,__ATOMIC_RELAXED);
+  pushTagged(w,t,g);
+}
+
+int requeueReady(worker_t *w, tcb_t *t) {
+  //Push a thread already on a ready deque again, at its current level; the
+  //entry left behind no longer matches, and is skipped when taken. Fails
+  //if a worker takes it first
+  unsigned short g = __atomic_load_n(&(t->ready_gen),__ATOMIC_ACQUIRE);
+  if(!(g & 1) || !__atomic_compare_exchange_n(&(t->ready_gen),&g,g+2,0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED)){
+    return 0;
+  }
+  pushTagged(w,t,g+2);
+  return 1;
+}
+
+void pushTagged(worker_t *w, tcb_t *t, unsigned short g) {
+  //Push onto its level, then mark the level so pickers see it
+  int level = prioLevel(t);
+  pushDeque(&(w->ready[level]),(tcb_t *) ((uintptr_t) t | (g & READY_TAG)));
+  __atomic_fetch_or(&(w->ready_bits),1ULL << level,__ATOMIC_SEQ_CST);
+  wakeTick(w);
+}
+
+int claimThread(tcb_t *t) {
+  //Take a thread off the ready deques wherever its entry is, which is left
+  //behind stale; fails if it is on none, or another worker won it
+  unsigned short g = __atomic_load_n(&(t->ready_gen),__ATOMIC_ACQUIRE);
+  return (g & 1) && __atomic_compare_exchange_n(&(t->ready_gen),&g,g+1,0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED);
+}
+
+tcb_t* claimReady(tcb_t *e) {
+  //Thread named by a deque entry if that was its latest push, taking it off
+  //the ready deques; null for a stale entry, or if another worker won it
+  tcb_t *t = READY_TCB(e);
+  unsigned short g = __atomic_load_n(&(t->ready_gen),__ATOMIC_ACQUIRE);
+  if(!(g & 1) || (g & READY_TAG) != ((uintptr_t) e & READY_TAG)){
+    return NULL;
+  }
+  if(!__atomic_compare_exchange_n(&(t->ready_gen),&g,g+1,0,__ATOMIC_ACQ_REL,__ATOMIC_RELAXED)){
+    return NULL;
+  }
+  return t;
+}
+
+int prioLevel(tcb_t *t) {
+  //Priority 0 is the highest level, anything past the last level shares it;
+  //an MLFQ thread sits depth levels below its priority
+  int level = t->thread_priority + t->depth;
+  if(level <= 0){
+    return 0;
+  }
+  if(level >= PRIO_LEVELS){
+    return PRIO_LEVELS-1;
+  }
+  return level;
+}
+
+void switchTo(worker_t *w, tcb_t *from, tcb_t *to) {
+  //Switch to new running thread; the tick timer keeps running, but a thread
+  //stolen by a tickless worker needs it started if others now wait
+  chargeSwitch(w, from, to);
+  w->current = to;
+  if(!w->ticking && to != w->idle && anyReady(w)){
+    wakeTick(w);
+  }
+  ctx_switch(from, to);
+
+  //Resumed, possibly on a different worker
+  finishSwitch();
+}
+
+void finishSwitch() {
+  worker_t *w = curWorker();
+
+  //Requeue the thread we switched away from, now that its registers are saved
+  if(w->requeue != NULL){
+    tcb_t *tmp = w->requeue;
+    w->requeue = NULL;
+    makeReady(tmp);
+  }
+
+  //Free the stacks of threads that exited on this worker, a batch at a
+  //time; we are off their stacks, and hold the lock t_exit() took
+  if(w->nzombies >= REAP_BATCH && w->unlock_pending){
+    reapZombies(w);
+  }
+
+  //Drop the scheduler lock the other thread held across the switch
+  if(w->unlock_pending){
+    w->unlock_pending = 0;
+    releaseSched();
+  }
+}
+
+void freeThread(tcb_t *t) {
+  //Return stack to the pool unless already reaped, and free context and TCB
+  if(!t->cold->reaped){
+    freeStack(t->cold->context.uc_stack.ss_sp, t->cold->context.uc_stack.ss_size);
+  }
+  if(t->cold->exited != NULL){
+    semDestroy(&(t->cold->exited));
+  }
+  free(t->cold->rt);
+  slabFree(SLAB_COLD,t->cold);
+  slabFree(SLAB_TCB,t);
+}
+
+void reapZombies(worker_t *w) {
+  //Free the stacks of all threads that exited on this worker; those nobody
+  //can join any more are freed entirely, the rest wait for t_join()
+  tcb_t *tmp;
+  while((tmp = rmQueue(w->zombies,-1)) != NULL){
+    if(tmp->cold->detached && tmp->cold->joiners == 0){
+      freeThread(tmp);
+    }
+    else{
+      freeStack(tmp->cold->context.uc_stack.ss_sp, tmp->cold->context.uc_stack.ss_size);
+      tmp->cold->reaped = 1;
+    }
+  }
+  w->nzombies = 0;
+}
+
+void releaseZombie(tcb_t *t) {
+  //Nobody new may join this zombie: drop its id, and free it once the
+  //reaper is done with it and woken joiners have taken the exit value
+  if(!t->cold->detached){
+    removeThread(t);
+    t->cold->detached = 1;
+  }
+  if(t->cold->reaped && t->cold->joiners == 0){
+    freeThread(t);
+  }
+}
+
+void reapThread(tcb_t *t) {
+  //Free one zombie's stack now, taking it off its worker's zombie queue
+  if(t->cold->reaped){
+    return;
+  }
+  int i;
+  for(i = 0; i < nworkers; i++){
+    if(t->queue == workers[i].zombies){
+      unlinkQueue(workers[i].zombies,t);
+      workers[i].nzombies--;
+      break;
+    }
+  }
+  freeStack(t->cold->context.uc_stack.ss_sp, t->cold->context.uc_stack.ss_size);
+  t->cold->reaped = 1;
+}
+
+void cancelThread(tcb_t *t) {
+  //Mark a live thread cancelled; if still queued on a semaphore, give back
+  //its place in the count and make it ready, so it sees the cancel and exits
+  if(t->state != T_LIVE){
+    return;
+  }
+  t->state = T_CANCELING;
+
+  //Waiting in sem_wait_any(), its stand-ins give their places back
+  if(t->cold->any != NULL && t->cold->any_index < 0){
+    dropProxies(t->cold);
+    makeReady(t);
+    return;
+  }
+
+  sem_t *sp = blockedOn(t);
+  if(sp != NULL){
+    unlinkWaiter(sp,t);
+    sp->count++;
+    t->cold->waiting_on = NULL;
+    if(sp->mutex && sp->owner != NULL){
+      //The holder no longer inherits from it
+      inheritPriority(sp->owner);
+    }
+    makeReady(t);
+  }
+}
+
+void testCancel() {
+  //Cancellation point: exit if the running thread has been cancelled
+  worker_t *w = curWorker();
+  if(w != NULL && w->current->state == T_CANCELING){
+    t_exit(T_CANCELED);
+  }
+}
+
+void cancelExit() {
+  //Exit a cancelled thread with the lock held, from inside a library call
+  exitThread(T_CANCELED);
+}
+
+void groupAdd(t_group_t *g, int tid) {
+  //Record a new member, growing the list as needed
+  if(g->count == g->cap){
+    g->cap *= 2;
+    g->tids = (int *) realloc(g->tids, g->cap * sizeof(int));
+  }
+  g->tids[g->count++] = tid;
+}
+
+void* slabAlloc(int type) {
+  //Zeroed object from the slab's free list, carving a new chunk if it is empty
+  slab_t *sl = &slabs[type];
+  void *p = sl->free;
+  if(p == NULL){
+    growSlab(sl);
+    p = sl->free;
+  }
+  else{
+    sl->reused++;
+  }
+  sl->free = *(void **) p;
+  sl->allocs++;
+  sl->live++;
+  memset(p,0,slabSize(sl));
+  return p;
+}
+
+void slabFree(int type, void *p) {
+  //Push the object back on its slab's free list
+  slab_t *sl = &slabs[type];
+  *(void **) p = sl->free;
+  sl->free = p;
+  sl->live--;
+}
+
+size_t slabSize(slab_t *sl) {
+  //Objects are whole cache lines, so no two share one
+  return (sl->size + CACHE_LINE - 1) & ~((size_t) CACHE_LINE - 1);
+}
+
+void growSlab(slab_t *sl) {
+  //A chunk's first cache line links it to the previous chunk, the rest is
+  //cut into objects
+  size_t size = slabSize(sl);
+  int n = (SLAB_CHUNK - CACHE_LINE) / size;
+  if(n < 1){
+    n = 1;
+  }
+  char *chunk = aligned_alloc(CACHE_LINE, CACHE_LINE + n*size);
+  if(chunk == NULL){
+    perror("aligned_alloc");
+    exit(EXIT_FAILURE);
+  }
+  *(void **) chunk = sl->chunks;
+  sl->chunks = chunk;
+  sl->nchunks++;
+
+  int i;
+  for(i = n-1; i >= 0; i--){
+    void *p = chunk + CACHE_LINE + i*size;
+    *(void **) p = sl->free;
+    sl->free = p;
+  }
+}
+
+void drainSlabs() {
+  //Free the chunks of every slab with nothing left allocated from it; a
+  //slab still in use, such as for a semaphore not yet destroyed, is kept
+  int i;
+  for(i = 0; i < SLAB_TYPES; i++){
+    slab_t *sl = &slabs[i];
+    if(sl->live != 0){
+      continue;
+    }
+    while(sl->chunks != NULL){
+      void *chunk = sl->chunks;
+      sl->chunks = *(void **) chunk;
+      free(chunk);
+    }
+    sl->free = NULL;
+    sl->nchunks = 0;
+    sl->allocs = sl->reused = 0;
+  }
+}
+
+void* allocStack(size_t size) {
+  //Reuse a pooled stack, or map a new one; only the default size is pooled
+  void *sp = stack_pool;
+  if(size != STACK_SIZE || sp == NULL){
+    return mapStack(size);
+  }
+  stack_pool = *(void **) sp;
+  stack_pool_count--;
+  return sp;
+}
+
+void freeStack(void *sp, size_t size) {
+  //The main thread and non-zero worker idle contexts have no pooled stack
+  if(sp == NULL){
+    return;
+  }
+
+  //Keep it mapped for the next thread, unless the pool is full or it is
+  //not the pooled size
+  if(size != STACK_SIZE || stack_pool_count >= STACK_POOL_MAX){
+    long page = sysconf(_SC_PAGESIZE);
+    munmap((char *) sp - page, size + page);
+    return;
+  }
+  *(void **) sp = stack_pool;
+  stack_pool = sp;
+  stack_pool_count++;
+}
+
+void* mapStack(size_t size) {
+  //Map a stack with a guard page below it, so an overflow faults instead of
+  //running into other memory; pages are only backed once touched
+  long page = sysconf(_SC_PAGESIZE);
+  char *base = mmap(NULL, size + page, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+  if(base == MAP_FAILED){
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  if(mprotect(base, page, PROT_NONE) == -1){
+    perror("mprotect");
+    exit(EXIT_FAILURE);
+  }
+  return base + page;
+}
+
+void warmStacks(int n) {
+  //Map stacks until n are free in the pool
+  while(stack_pool_count < n && stack_pool_count < STACK_POOL_MAX){
+    freeStack(mapStack(STACK_SIZE), STACK_SIZE);
+  }
+}
+
+void stackUsage(void *sp, size_t size, t_stack_stats_t *st) {
+  //Add a stack's reserved bytes, and the pages mincore() reports resident;
+  //the stack grows down, so its depth is measured from the top to the
+  //lowest resident page
+  if(sp == NULL){
+    return;
+  }
+  long page = sysconf(_SC_PAGESIZE);
+  size_t pages = size / page;
+  unsigned char *vec = malloc(pages);
+  if(mincore(sp, size, vec) == -1){
+    perror("mincore");
+    exit(EXIT_FAILURE);
+  }
+  size_t i, committed = 0, depth = 0;
+  for(i = 0; i < pages; i++){
+    if(vec[i] & 1){
+      committed += page;
+      if(depth == 0){
+        depth = size - i * page;
+      }
+    }
+  }
+  free(vec);
+
+  st->reserved += size;
+  st->committed += committed;
+  if(depth > st->high_water){
+    st->high_water = depth;
+  }
+}
+
+void drainStacks() {
+  //Unmap all free stacks
+  long page = sysconf(_SC_PAGESIZE);
+  while(stack_pool != NULL){
+    void *sp = stack_pool;
+    stack_pool = *(void **) sp;
+    munmap((char *) sp - page, STACK_SIZE + page);
+  }
+  stack_pool_count = 0;
+}
+
+void* workerMain(void *arg) {
+  worker_t *w = (worker_t *) arg;
+  w->preempt_off = 1;
+  this_worker = w;
+
+  //This kernel thread's own stack serves as the worker's idle context
+  tcb_t *idle = (tcb_t *) calloc(1,sizeof(tcb_t));
+  idle->thread_id = -2;
+  idle->pinned_worker = w->id;
+  idle->cold = (tcbCold *) calloc(1,sizeof(tcbCold));
+
+  w->idle = idle;
+  w->current = idle;
+  initTick(w);
+  workerLoop(w);
+  timer_delete(w->tick_timer);
+
+  free(idle->cold);
+  free(idle);
+  return NULL;
+}
+
+void workerLoop(worker_t *w) {
+  //Run ready threads until shutdown, called and returns with preemption off
+  while(!(shutting_down && w->id != 0)){
+    tcb_t *next = pickNext(w);
+    if(next != NULL){
+      //Back here once a thread on this worker blocks with nothing else ready
+      switchTo(w, w->idle, next);
+    }
+    else{
+      //Nothing to run, a good time to free exited threads, then sleep
+      acquireSched();
+      if(w->nzombies > 0){
+        reapZombies(w);
+      }
+      parkWorker(w);
+    }
+  }
+}
+
+void parkWorker(worker_t *w) {
+  //Sleep until a thread is made ready, this worker's next periodic release
+  //is due, or shutdown; called with the lock held, and drops it. The last
+  //worker to park, with nothing left to run or release, reports deadlock
+  int seq = __atomic_load_n(&(w->wake_seq),__ATOMIC_SEQ_CST);
+  __atomic_store_n(&(w->parked),1,__ATOMIC_SEQ_CST);
+  int n = __atomic_add_fetch(&nparked,1,__ATOMIC_SEQ_CST);
+  int runnable = shutting_down || anyRunnable(w);
+  if(!runnable && n == nworkers){
+    //A worker just woken still counts as parked, so look in every inbox
+    int i, pending = 0;
+    for(i = 0; i < nworkers; i++){
+      if(workers[i].next_release != NO_RELEASE || inboxLevel(&workers[i]) < PRIO_LEVELS){
+        pending = 1;
+      }
+    }
+    //With threads left waiting that is a deadlock; with none, every thread
+    //has finished and nothing can start another
+    if(!pending && anyBlocked()){
+      deadlocked();
+    }
+    if(!pending){
+      exit(EXIT_SUCCESS);
+    }
+  }
+  releaseSched();
+
+  if(!runnable){
+    //Anything made ready from here on bumps wake_seq, so it is not missed;
+    //the tick and kicks from pthread_kill() end the sleep early too
+    struct timespec ts, *tp = NULL;
+    long long release = w->next_release;
+    if(release != NO_RELEASE){
+      long long d = release - nowNs();
+      if(d < 0){
+        d = 0;
+      }
+      ts.tv_sec = d / 1000000000LL;
+      ts.tv_nsec = d % 1000000000LL;
+      tp = &ts;
+    }
+    preemptOn();
+    syscall(SYS_futex,&(w->wake_seq),FUTEX_WAIT_PRIVATE,seq,tp,NULL,0);
+    preemptOff();
+  }
+  __atomic_store_n(&(w->parked),0,__ATOMIC_SEQ_CST);
+  __atomic_sub_fetch(&nparked,1,__ATOMIC_SEQ_CST);
+}
+
+void wakeWorker(worker_t *w) {
+  //Wake a worker from parkWorker(), if it is there
+  if(__atomic_load_n(&(w->parked),__ATOMIC_SEQ_CST)){
+    __atomic_fetch_add(&(w->wake_seq),1,__ATOMIC_SEQ_CST);
+    syscall(SYS_futex,&(w->wake_seq),FUTEX_WAKE_PRIVATE,1,NULL,NULL,0);
+  }
+}
+
+void wakeParked(worker_t *w) {
+  //A thread just made ready on this worker can be taken by another, so wake
+  //one parked worker, if any, to come and look
+  if(__atomic_load_n(&nparked,__ATOMIC_SEQ_CST) == 0){
+    return;
+  }
+  int i;
+  for(i = 1; i < nworkers; i++){
+    worker_t *v = &workers[(w->id + i) % nworkers];
+    if(__atomic_load_n(&(v->parked),__ATOMIC_SEQ_CST)){
+      wakeWorker(v);
+      return;
+    }
+  }
+}
+
+int anyBlocked() {
+  //Whether any live thread waits on a semaphore, mailbox, join or several
+  //semaphores in sem_wait_any()
+  int i;
+  for(i = 0; i < nslots; i++){
+    tcb_t *t = slots[i].tcb;
+    if(t == NULL || t->state == T_ZOMBIE){
+      continue;
+    }
+    if(blockedOn(t) != NULL || (t->cold->any != NULL && t->cold->any_index < 0)){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void deadlocked() {
+  //Every thread is blocked and nothing is left to wake one: say which
+  //threads wait on what, and give up
+  fprintf(stderr,"all threads deadlocked\n");
+  int i;
+  for(i = 0; i < nslots; i++){
+    tcb_t *t = slots[i].tcb;
+    if(t != NULL && t->cold->any != NULL && t->cold->any_index < 0){
+      fprintf(stderr,"  thread %d%s%s blocked on %d semaphores in sem_wait_any\n",t->thread_id,
+              t->cold->name[0] ? " " : "",t->cold->name,t->cold->nany);
+      continue;
+    }
+    sem_t *sp = (t != NULL && t->state != T_ZOMBIE) ? blockedOn(t) : NULL;
+    if(sp == NULL){
+      continue;
+    }
+    fprintf(stderr,"  thread %d%s%s blocked on %s %p",t->thread_id,
+            t->cold->name[0] ? " " : "",t->cold->name,sp->mutex ? "mutex" : "semaphore",(void *) sp);
+    tcb_t *u = waitsFor(t);
+    if(u != NULL){
+      fprintf(stderr,", %s thread %d",t->cold->wait_for != 0 ? "waiting for" : "held by",u->thread_id);
+    }
+    fprintf(stderr,"\n");
+  }
+  exit(EXIT_FAILURE);
+}
+
+tcb_t* waitsFor(tcb_t *t) {
+  //The one thread a blocked thread waits on: the peer it named to t_join(),
+  //block_send() or receive(), a mutex's owner, or whoever took a binary
+  //semaphore; NULL if not blocked, or if any of several could wake it
+  tcb_t *u = NULL;
+  if(t->cold->any != NULL && t->cold->any_index < 0){
+    //In sem_wait_any(), only if one thread holds every semaphore it names
+    int i;
+    for(i = 0; i < t->cold->nany; i++){
+      tcb_t *v = semHolder(t->cold->any_sems[i]);
+      if(t->cold->any[i] == NULL || t->cold->any[i]->queue == NULL){
+        return NULL;
+      }
+      if(v == NULL || (u != NULL && v != u)){
+        return NULL;
+      }
+      u = v;
+    }
+    return (u != NULL && u->state != T_ZOMBIE) ? u : NULL;
+  }
+  sem_t *sp = blockedOn(t);
+  if(sp == NULL){
+    return NULL;
+  }
+  if(t->cold->wait_for != 0){
+    u = findThread(t->cold->wait_for);
+  }
+  else{
+    u = semHolder(sp);
+  }
+  return (u != NULL && u->state != T_ZOMBIE) ? u : NULL;
+}
+
+tcb_t* semHolder(sem_t *sp) {
+  //The thread a semaphore waits on to be given back: a mutex's owner, or
+  //whoever took a binary semaphore; NULL for any other
+  if(sp->mutex){
+    return sp->owner;
+  }
+  if(sp->binary && sp->holder != 0){
+    return findThread(sp->holder);
+  }
+  return NULL;
 }
 
-void t_create(void (*fct)(int), int id, int pri) {
-  if(ready_high != NULL && ready_low != NULL && all != NULL){
-    //Allocate space for new thread
-    tcb_t *tmp = (tcb_t *) calloc(1,sizeof(tcb_t));
-    if(id < 0){
-      perror("ID must be > 0");
-      exit(EXIT_FAILURE);
+int findCycle(int *tids, int max, int fresh) {
+  //Every thread has at most one wait-for edge, so a walk along them either
+  //ends or comes back round to a thread on it; walks are stamped, and stop
+  //at any thread an earlier one went through, so each thread is visited
+  //once. Fills in the first cycle found, with fresh the first not already
+  //reported, which it then marks; returns its length
+  int i;
+  if(deadlock_stamp > INT_MAX - nslots - 1){
+    for(i = 0; i < nslots; i++){
+      if(slots[i].tcb != NULL){
+        slots[i].tcb->cold->dl_mark = 0;
+      }
     }
-    if(findById(all,id) != NULL){
-      perror("ID must be unique");
-      exit(EXIT_FAILURE);
+    deadlock_stamp = 0;
+  }
+  int base = deadlock_stamp;
+  for(i = 0; i < nslots; i++){
+    tcb_t *t = slots[i].tcb;
+    int stamp = ++deadlock_stamp;
+    while(t != NULL && t->state != T_ZOMBIE && t->cold->dl_mark <= base){
+      t->cold->dl_mark = stamp;
+      t = waitsFor(t);
     }
-    tmp->thread_id = id;
-    tmp->thread_priority = pri;
-    mbox_create(&(tmp->mail));
-    tmp->thread_context = (ucontext_t *) calloc(1,sizeof(ucontext_t));
-
-    if (getcontext(tmp->thread_context) == -1) {
-      perror("getcontext");
-      exit(EXIT_FAILURE);
+    if(t == NULL || t->cold->dl_mark != stamp){
+      continue;
     }
 
-    //Create thread context
-    size_t sz = 0x2000; //Errors with larger sizes
-    tmp->thread_context->uc_stack.ss_sp = calloc(1,sz);
-    //uc->uc_stack.ss_sp = mmap(0, sz,
-    //     PROT_READ | PROT_WRITE | PROT_EXEC,
-    //     MAP_PRIVATE | MAP_ANON, -1, 0);
-    tmp->thread_context->uc_stack.ss_size = sz;
-    tmp->thread_context->uc_stack.ss_flags = 0;
-    tmp->thread_context->uc_link = running->head->thread_context; 
-    makecontext(tmp->thread_context, (void (*)()) fct, 1, id);
-    
-    //Queue thread according to priority
-    addQueue(all,tmp);
-    if(pri == 0){
-      addQueue(ready_high,tmp);
+    //Back at a thread from this walk: it and what it waits on are a cycle
+    int n = 0, seen = 1;
+    tcb_t *u = t;
+    do{
+      if(n < max){
+        tids[n] = u->thread_id;
+      }
+      n++;
+      seen &= u->cold->dl_reported;
+      u = waitsFor(u);
+    } while(u != t);
+    if(fresh && seen){
+      continue;
     }
-    else{
-      addQueue(ready_low,tmp);
+    if(fresh){
+      do{
+        u->cold->dl_reported = 1;
+        u = waitsFor(u);
+      } while(u != t);
     }
+    return n;
   }
+  return 0;
 }
 
-void t_yield() {
-  //Ignore alarms
-  sighold(SIGALRM);
-  
-  if(running != NULL && ready_high != NULL && ready_low != NULL && (ready_high->head != NULL || ready_low->head != NULL)){
-    //Cancel alarm
-    ualarm(0,0);
-    
-    //Move next ready thread into running queue
-    tcb_t *tmp = rmQueue(running,-1);
-    if(ready_high->head != NULL){
-      addQueue(running,rmQueue(ready_high,-1));
-    }
-    else{
-      addQueue(running,rmQueue(ready_low,-1));
-    }
-    
-    //Move running thread into ready queue
-    if(tmp->thread_priority == 0){
-      addQueue(ready_high,tmp);
-    }
-    else{
-      addQueue(ready_low,tmp);
-    }
-    if(running->head == NULL){
-      perror("ready empty");
-      exit(EXIT_FAILURE);
-    }
-    
-    //Set scheduling alarm, and switch to new running thread
-    ualarm(timeout,0);
-    swapcontext(tmp->thread_context, running->head->thread_context);
+void checkDeadlocks() {
+  //Once per deadlock_period, on whichever worker comes first after the tick
+  //flags it: report a wait-for cycle nobody has heard of yet, outside the lock
+  long long now = nowNs(), due = deadlock_due;
+  if(now < due || !__atomic_compare_exchange_n(&deadlock_due,&due,now + deadlock_period,0,
+                                                  __ATOMIC_SEQ_CST,__ATOMIC_SEQ_CST)){
+    return;
+  }
+  int tids[T_DEADLOCK_MAX];
+  lockSched();
+  int n = findCycle(tids,T_DEADLOCK_MAX,1);
+  void (*report)(const int *, int) = deadlock_report;
+  unlockSched();
+  if(n > 0 && report != NULL){
+    report(tids,n < T_DEADLOCK_MAX ? n : T_DEADLOCK_MAX);
   }
-  sigrelse(SIGALRM);
 }
 
-void t_terminate() {
-  //Ignore alarms
-  sighold(SIGALRM);
-  
-  if(running != NULL && ready_high != NULL && ready_low != NULL && (ready_high->head != NULL || ready_low->head != NULL)){
-    //Cancel alarm
-    ualarm(0,0);
-    
-    //Pop current running thread
-    tcb_t *tmp = rmQueue(running,-1);
-
-    //Queue next thread from ready queue
-    if(ready_high->head != NULL){
-      addQueue(running,rmQueue(ready_high,-1));
-    }
-    else{
-      addQueue(running,rmQueue(ready_low,-1));
-    }
-    if(running->head == NULL){
-      perror("ready empty, no thread to run");
-      exit(EXIT_FAILURE);
-    }
-    
-    //Erase currently running thread
-    rmQueue(all,tmp->thread_id);
-    mbox_destroy(&(tmp->mail));
-    free(tmp->thread_context->uc_stack.ss_sp);
-    free(tmp->thread_context);
-    free(tmp);
-    
-    //Set scheduling alarm, and switch to new running thread
-    ualarm(timeout,0);
-    setcontext(running->head->thread_context);
+void printCycle(const int *tids, int n) {
+  //Default report: the cycle on one line, back round to its first thread
+  char buf[32 + T_DEADLOCK_MAX * 24];
+  int len = snprintf(buf,sizeof(buf),"deadlock:");
+  int i;
+  for(i = 0; i < n; i++){
+    len += snprintf(buf + len,sizeof(buf) - len," thread %d ->",tids[i]);
+  }
+  len += snprintf(buf + len,sizeof(buf) - len," thread %d\n",tids[0]);
+  if(write(STDERR_FILENO,buf,len) < 0){
+    return;
   }
-  sigrelse(SIGALRM);
 }
 
-void t_shutdown() {
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  if(all != NULL){
-    tcb_t *iter = all->head;
-    while(iter != NULL){
-      tcb_t *tmp = iter;
-      iter = iter->next_all;
-      mbox_destroy(&(tmp->mail));
-      free(tmp->thread_context->uc_stack.ss_sp);
-      free(tmp->thread_context);
-      free(tmp);
-    }
-    free(all);
-  }
-  if(running != NULL){
-    free(running);
-  }
-  if(ready_high != NULL){
-    free(ready_high);
-  }
-  if(ready_low != NULL){
-    free(ready_low);
-  }
-  
-  //Set queues to null, so fns can tell not initialized
-  ready_low = NULL;
-  ready_high = NULL;
-  running = NULL;
-  all = NULL;
-  sigrelse(SIGALRM);
+void idleStart() {
+  //Worker 0's idle context, entered from a switch with preemption off
+  finishSwitch();
+  workerLoop(curWorker());
 }
 
-void sem_init(sem_t **sp, int sem_count) {
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  //Allocate new semaphore with provided count
-  *sp = calloc(1,sizeof(sem_t));
-  (*sp)->count = sem_count;
-  (*sp)->q = createQueue();
-  
-  sigrelse(SIGALRM);
+tQueue_t* createQueue() {
+  //Allocate space for new Queue, its sentinel linked to itself when empty
+  tQueue_t *tmp = (tQueue_t *) slabAlloc(SLAB_QUEUE);
+  tmp->head.next = tmp->head.prev = &(tmp->head);
+  return tmp;
 }
 
-void sem_wait(sem_t *sp) {
- //Ignore timer
-  sighold(SIGALRM);
+void addQueue(tQueue_t *q, tcb_t *t) {
+  //Link in before the sentinel, at the tail
+  tLink *l = &(t->link);
+  l->prev = q->head.prev;
+  l->next = &(q->head);
+  q->head.prev->next = l;
+  q->head.prev = l;
+  t->queue = q;
+}
 
-  sp->count--;
-  
-  //Block current thread and switch if counter goes negative
-  if(sp->count < 0){
-    if(running != NULL && ready_high != NULL && ready_low != NULL && (ready_high->head != NULL || ready_low->head != NULL)){
-      //Cancel alarm
-      ualarm(0,0);
-      
-      //Move next ready thread into running queue
-      tcb_t *tmp = rmQueue(running,-1);
-      addQueue(sp->q,tmp);
-      if(ready_high->head != NULL){
-        addQueue(running,rmQueue(ready_high,-1));
-      }
-      else{
-        addQueue(running,rmQueue(ready_low,-1));
-      }
-      
-      //Set scheduling alarm, and switch to new running thread
-      ualarm(timeout,0);
-      swapcontext(tmp->thread_context, running->head->thread_context);
-    }    
-  }
-  sigrelse(SIGALRM);
+void insertQueue(tQueue_t *q, tcb_t *after, tcb_t *t) {
+  //Link in after a thread already on the queue, or at the head for null
+  tLink *prev = (after == NULL) ? &(q->head) : &(after->link);
+  tLink *l = &(t->link);
+  l->prev = prev;
+  l->next = prev->next;
+  prev->next->prev = l;
+  prev->next = l;
+  t->queue = q;
 }
 
-void sem_signal(sem_t *sp) {
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  sp->count++;
-  
-  //Move thread out of semaphore queue back into ready queues if count going positive
-  if(sp->count <= 0){
-    if(running != NULL && ready_high != NULL && ready_low != NULL){
-      
-      //Move next thread from semaphore queue into ready queue
-      tcb_t *tmp = rmQueue(sp->q,-1);
-      if(tmp->thread_priority == 0){
-        addQueue(ready_high,tmp);
-      }
-      else{
-        addQueue(ready_low,tmp);
-      }
-    }
+tcb_t* rmQueue(tQueue_t *q, int tid) {
+  //Head of the queue for -1, otherwise the thread with that TID if it is
+  //on this queue; the lookup needs the scheduler lock
+  tcb_t *tmp = (tid == -1) ? queueHead(q) : findThread(tid);
+  if(tmp == NULL || tmp->queue != q){
+    return NULL;
   }
-  sigrelse(SIGALRM);
+  unlinkQueue(q,tmp);
+  return tmp;
 }
 
-void sem_destroy(sem_t **sp){
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  //Move all threads waiting on semaphore into ready queues
-  tcb_t *iter = (*sp)->q->head;
-  while(iter != NULL){
-    tcb_t *tmp = iter;
-    iter = iter->next;
-    if(tmp->thread_priority == 0){
-      addQueue(ready_high,tmp);
-    }
-    else{
-      addQueue(ready_low,tmp);
-    }
+void unlinkQueue(tQueue_t *q, tcb_t *t) {
+  //Remove a thread from anywhere in the queue
+  (void) q;
+  tLink *l = &(t->link);
+  l->prev->next = l->next;
+  l->next->prev = l->prev;
+  l->next = l->prev = NULL;
+  t->queue = NULL;
+}
+
+tcb_t* findById(tQueue_t *q, int tid){
+  //Thread with that TID if it is on this queue, or null
+  tcb_t *tmp = findThread(tid);
+  if(tmp == NULL || tmp->queue != q){
+    return NULL;
   }
-  
-  //Free semaphore memory allocations
-  free((*sp)->q);
-  free(*sp);
-  
-  sigrelse(SIGALRM);  
+  return tmp;
 }
 
-void mbox_create(mbox **mb){
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  //Allocate space for new mbox
-  mbox *new_mbox = (mbox *) calloc(1,sizeof(mbox));
-  new_mbox->msg = NULL;
-  sem_init(&(new_mbox->mbox_send),1); //Allow sending
-  sem_init(&(new_mbox->mbox_recv),0); //No messages yet
-  *mb = new_mbox;
-  
-  sigrelse(SIGALRM);
+tcb_t* queueHead(tQueue_t *q) {
+  //First thread, or null if empty
+  if(q->head.next == &(q->head)){
+    return NULL;
+  }
+  return LINK_TCB(q->head.next);
 }
 
-void mbox_destroy(mbox **mb){
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  //Loop over messages and destroy all
-  messageNode *tmp = (*mb)->msg;
-  while(tmp != NULL){
-    messageNode *tmp2 = tmp;
-    tmp = tmp->next;
-    sem_signal(tmp2->recv_wait);
-    sem_destroy(&(tmp2->recv_wait));
-    free(tmp2->message);
-    free(tmp2);
+tcb_t* queueNext(tQueue_t *q, tcb_t *t) {
+  //Thread after t, or null at the tail
+  if(t->link.next == &(q->head)){
+    return NULL;
   }
-  
-  //Destroy semaphores and mailbox
-  sem_destroy(&((*mb)->mbox_send));
-  sem_destroy(&((*mb)->mbox_recv));
-  free(*mb);
-  
-  sigrelse(SIGALRM);
+  return LINK_TCB(t->link.next);
 }
 
-void mbox_deposit(mbox *mb, char *msg, int len){
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  //Allocate new messageNode
-  messageNode *new_msg = calloc(1,sizeof(messageNode));
-  new_msg->message = calloc(len+1,sizeof(char));
-  strncpy(new_msg->message, msg, len+1);
-  new_msg->len = len+1;
-  new_msg->sender = running->head->thread_id;
-  sem_init(&(new_msg->recv_wait),0);
-  new_msg->next = NULL;
-  
-  //Acquire lock on mailbox sending
-  sem_wait(mb->mbox_send);
-  
-  //Append message to mailbox
-  if(mb->msg == NULL){
-    mb->msg = new_msg;
+void initThreadTable() {
+  //Start with a small slot table, all slots on the free list
+  nslots = 64;
+  slots = (threadSlot *) calloc(nslots,sizeof(threadSlot));
+  int i;
+  for(i = 0; i < nslots; i++){
+    slots[i].next_free = (i+1 < nslots) ? i+1 : -1;
   }
-  else{
-    messageNode *head_msg = mb->msg;
-    while(head_msg->next != NULL){
-      head_msg = head_msg->next;
-    }
-    head_msg->next = new_msg;
+  free_slot = 0;
+
+  //And an empty tid index
+  tid_cap = 128;
+  tid_used = 0;
+  tid_index = (tidEntry *) malloc(tid_cap*sizeof(tidEntry));
+  for(i = 0; i < tid_cap; i++){
+    tid_index[i].slot = TID_EMPTY;
   }
-  
-  //Release mailbox sending lock
-  sem_signal(mb->mbox_send);
-  
-  //Increase count of messages to be received
-  sem_signal(mb->mbox_recv);
-  
-  sigrelse(SIGALRM);
 }
 
-void mbox_withdraw(mbox *mb, char *msg, int *len){
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  //Get first message in mailbox
-  messageNode *head_msg = mb->msg;
-  
-  if(head_msg == NULL){
-    //Mailbox is empty
-    *len = 0;
+void freeThreadTable() {
+  free(slots);
+  free(tid_index);
+  slots = NULL;
+  tid_index = NULL;
+  nslots = tid_cap = tid_used = 0;
+  free_slot = -1;
+}
+
+void addThread(tcb_t *t, int handle) {
+  //Take a free slot, doubling the table when there is none
+  if(free_slot < 0){
+    int old = nslots;
+    nslots *= 2;
+    slots = (threadSlot *) realloc(slots,nslots*sizeof(threadSlot));
+    memset(&slots[old],0,(nslots-old)*sizeof(threadSlot));
+    int i;
+    for(i = old; i < nslots; i++){
+      slots[i].next_free = (i+1 < nslots) ? i+1 : -1;
+    }
+    free_slot = old;
   }
-  else{
-    //Transfer message attributes to arguments
-    strncpy(msg,head_msg->message,head_msg->len);
-    *len = head_msg->len-1;
-    
-    //Remove message from list and destroy it
-    mb->msg = head_msg->next;
-    sem_signal(head_msg->recv_wait);
-    sem_destroy(&(head_msg->recv_wait));
-    free(head_msg->message);
-    free(head_msg);
+  int slot = free_slot;
+  free_slot = slots[slot].next_free;
+  slots[slot].tcb = t;
+  t->cold->slot = slot;
+
+  //A thread without an id gets a handle naming its slot and the slot's
+  //generation, so the id goes stale once the slot is reused
+  if(handle){
+    if(slot > T_SLOT_MASK){
+      perror("Too many threads");
+      exit(EXIT_FAILURE);
+    }
+    t->thread_id = T_HANDLE | ((slots[slot].gen & T_GEN_MASK) << T_SLOT_BITS) | slot;
+    while(lookupTid(t->thread_id) >= 0){
+      //Taken by an explicit id, move on a generation
+      slots[slot].gen++;
+      t->thread_id = T_HANDLE | ((slots[slot].gen & T_GEN_MASK) << T_SLOT_BITS) | slot;
+    }
   }
-  sigrelse(SIGALRM);
+  indexTid(t->thread_id,slot);
 }
 
-void send(int tid, char *msg, int len){
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  //Find TCB of thread to send to
-  tcb_t *tmp = findById(all,tid);
-  if(tmp == NULL){
-    sigrelse(SIGALRM);
-    return;
+void removeThread(tcb_t *t) {
+  //Drop its tid, and put its slot back on the free list with a new generation
+  unindexTid(t->thread_id);
+  int slot = t->cold->slot;
+  slots[slot].tcb = NULL;
+  slots[slot].gen++;
+  slots[slot].next_free = free_slot;
+  free_slot = slot;
+}
+
+tcb_t* findThread(int tid) {
+  //Live thread with this tid, or NULL
+  if(slots == NULL){
+    return NULL;
   }
-  
-  //Allocate new messageNode
-  messageNode *new_msg = calloc(1,sizeof(messageNode));
-  new_msg->message = calloc(len+1,sizeof(char));
-  strncpy(new_msg->message, msg, len+1);
-  new_msg->len = len+1;
-  new_msg->sender = running->head->thread_id;
-  new_msg->receiver = tid;
-  sem_init(&(new_msg->recv_wait),0);
-  
-  //Acquire lock on mailbox sending
-  sem_wait(tmp->mail->mbox_send);
-  
-  //Append message to mailbox
-  if(tmp->mail->msg == NULL){
-    tmp->mail->msg = new_msg;
+  int i = lookupTid(tid);
+  if(i < 0){
+    return NULL;
   }
-  else{
-    messageNode *head_msg = tmp->mail->msg;
-    while(head_msg->next != NULL){
-      head_msg = head_msg->next;
+  return slots[tid_index[i].slot].tcb;
+}
+
+unsigned int hashTid(int tid) {
+  //Fibonacci hashing, tid_cap is a power of two
+  return ((unsigned int) tid * 2654435769u) & (tid_cap - 1);
+}
+
+int lookupTid(int tid) {
+  //Index entry holding tid, or -1; probes past deleted entries
+  unsigned int i = hashTid(tid);
+  while(tid_index[i].slot != TID_EMPTY){
+    if(tid_index[i].slot != TID_DELETED && tid_index[i].tid == tid){
+      return i;
     }
-    head_msg->next = new_msg;
+    i = (i + 1) & (tid_cap - 1);
   }
-  
-  //Release mailbox sending lock
-  sem_signal(tmp->mail->mbox_send);
-  
-  //Increase count of messages to be received
-  sem_signal(tmp->mail->mbox_recv);
-  
-  sigrelse(SIGALRM);
+  return -1;
 }
 
-void receive(int *tid, char *msg, int *len){
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  //Wait for number of messages to be non-zero
-  sem_wait(running->head->mail->mbox_recv);
-  
-  //Loop over messages looking for a TID match
-  messageNode *tmp_msg = running->head->mail->msg;
-  if(tmp_msg == NULL){
-    //Shouldn't happen
-    *len = 0;
-  }
-  else{
-    //Prevent sending while receiving
-    sem_wait(running->head->mail->mbox_send);
-    
-    //Special case for first message in the list
-    if(*tid == 0 || *tid == tmp_msg->sender){
-      //Transfer message attributes to arguments
-      strncpy(msg,tmp_msg->message,tmp_msg->len);
-      *len = tmp_msg->len-1;
-      *tid = tmp_msg->sender;
-      
-      //Remove message from list and destroy it
-      messageNode *tmp_msg2 = tmp_msg;
-      running->head->mail->msg = tmp_msg->next;
-      sem_signal(tmp_msg2->recv_wait);
-      sem_destroy(&(tmp_msg2->recv_wait));
-      free(tmp_msg2->message);
-      free(tmp_msg2);
-    }
-    else{
-      //Loop over messages until TID match found
-      while(tmp_msg->next != NULL){
-        if(*tid == 0 || *tid == tmp_msg->next->sender){
-          //Transfer message attributes to arguments
-          strncpy(msg,tmp_msg->next->message,tmp_msg->next->len);
-          *len = tmp_msg->next->len-1;
-          *tid = tmp_msg->sender;
-          
-          //Remove message from list and destroy it
-          messageNode *tmp_msg2 = tmp_msg->next;
-          tmp_msg->next = tmp_msg->next->next;
-          sem_signal(tmp_msg2->recv_wait);
-          sem_destroy(&(tmp_msg2->recv_wait));
-          free(tmp_msg2->message);
-          free(tmp_msg2);
-          break;
-        }
-        tmp_msg = tmp_msg->next;
+void indexTid(int tid, int slot) {
+  //Keep the index at most half full, counting deleted entries; grow it
+  //only if live entries need the room
+  if(2*(tid_used+1) > tid_cap){
+    int live = 0, i;
+    for(i = 0; i < tid_cap; i++){
+      if(tid_index[i].slot >= 0){
+        live++;
       }
     }
-    //Allow sending to mailbox again
-    sem_signal(running->head->mail->mbox_send);
+    rehashTids(4*(live+1) > tid_cap ? 2*tid_cap : tid_cap);
   }
-  //Decrement count of messages to be received
-  sem_signal(running->head->mail->mbox_recv);
-  
-  sigrelse(SIGALRM);
+
+  unsigned int i = hashTid(tid);
+  while(tid_index[i].slot >= 0){
+    i = (i + 1) & (tid_cap - 1);
+  }
+  if(tid_index[i].slot == TID_EMPTY){
+    tid_used++;
+  }
+  tid_index[i].tid = tid;
+  tid_index[i].slot = slot;
 }
 
-void block_send(int tid, char *msg, int len){
-  //Ignore timer
-  sighold(SIGALRM);
-  
-  //Find TCB of thread to send to
-  tcb_t *tmp = findById(all,tid);
-  if(tmp == NULL){
-    sigrelse(SIGALRM);
-    return;
+void unindexTid(int tid) {
+  //Leave a deleted marker, so later entries stay reachable
+  int i = lookupTid(tid);
+  if(i >= 0){
+    tid_index[i].slot = TID_DELETED;
   }
-  
-  //Allocate new messageNode
-  messageNode *new_msg = calloc(1,sizeof(messageNode));
-  new_msg->message = calloc(len+1,sizeof(char));
-  strncpy(new_msg->message, msg, len+1);
-  new_msg->len = len+1;
-  new_msg->sender = running->head->thread_id;
-  new_msg->receiver = tid;
-  sem_init(&(new_msg->recv_wait),0);
-  
-  //Acquire lock on mailbox sending
-  sem_wait(tmp->mail->mbox_send);
-  
-  //Append message to mailbox
-  if(tmp->mail->msg == NULL){
-    tmp->mail->msg = new_msg;
+}
+
+void rehashTids(int cap) {
+  //Move live entries into a fresh index, dropping deleted markers
+  tidEntry *old = tid_index;
+  int old_cap = tid_cap, i;
+  tid_cap = cap;
+  tid_used = 0;
+  tid_index = (tidEntry *) malloc(tid_cap*sizeof(tidEntry));
+  for(i = 0; i < tid_cap; i++){
+    tid_index[i].slot = TID_EMPTY;
   }
-  else{
-    messageNode *head_msg = tmp->mail->msg;
-    while(head_msg->next != NULL){
-      head_msg = head_msg->next;
+  for(i = 0; i < old_cap; i++){
+    if(old[i].slot >= 0){
+      unsigned int j = hashTid(old[i].tid);
+      while(tid_index[j].slot != TID_EMPTY){
+        j = (j + 1) & (tid_cap - 1);
+      }
+      tid_index[j] = old[i];
+      tid_used++;
     }
-    head_msg->next = new_msg;
   }
-  
-  //Release mailbox sending lock
-  sem_signal(tmp->mail->mbox_send);
-  
-  //Increase count of messages to be received
-  sem_signal(tmp->mail->mbox_recv);
-  
-  //Wait for message to be received or destroyed
-  sem_wait(new_msg->recv_wait);
-  
-  sigrelse(SIGALRM);
+  free(old);
 }
 
-void block_receive(int *tid, char *msg, int *len){
-  //standard receive already blocks
-  receive(tid,msg,len);
+void initHeap(tHeap *h) {
+  //Start with room for 16 threads, grown on demand
+  h->count = 0;
+  h->cap = 16;
+  h->lock = 0;
+  h->entries = (heapEntry *) malloc(h->cap * sizeof(heapEntry));
 }
 
-void sig_handler() {
-  //If SIGALRM received, force current running thread to yield
-  t_yield();
+void lockHeap(tHeap *h) {
+  while(__atomic_exchange_n(&(h->lock),1,__ATOMIC_ACQUIRE)){
+    sched_yield();
+  }
 }
 
-void init_alarm() {
-  //Start scheduling alarms on timeout interval
-  sigset(SIGALRM, sig_handler);
-  ualarm(timeout,0);
+void unlockHeap(tHeap *h) {
+  __atomic_store_n(&(h->lock),0,__ATOMIC_RELEASE);
 }
 
-tQueue_t* createQueue() {
-  //Allocate space for new Queue
-  tQueue_t *tmp = (tQueue_t *) calloc(1,sizeof(tQueue_t));
-  tmp->head = tmp->tail = NULL;
-  return tmp;
+void pushHeap(tHeap *h, long long key, tcb_t *t) {
+  //Append, then sift up
+  if(h->count == h->cap){
+    h->cap *= 2;
+    h->entries = (heapEntry *) realloc(h->entries, h->cap * sizeof(heapEntry));
+  }
+  heapEntry *e = h->entries;
+  int i = h->count;
+  while(i > 0 && e[(i-1)/2].key > key){
+    e[i] = e[(i-1)/2];
+    i = (i-1)/2;
+  }
+  e[i].key = key;
+  e[i].t = t;
+  h->count++;
 }
 
-void addQueue(tQueue_t *q, tcb_t *t) {
-  //Special case for all queue
-  if(q == all){
-    //If queue empty, head = tail
-    if(q->tail == NULL){
-      q->head = q->tail =  t;
-      q->tail->next_all = NULL;
-    }
-    //Otherwise, append to list
-    else{
-      q->tail->next_all = t;
-      q->tail = t;
-      q->tail->next_all = NULL;
+heapEntry popHeap(tHeap *h) {
+  //Take the root, then sift the last entry down from it; the heap is non-empty
+  heapEntry *e = h->entries;
+  heapEntry top = e[0];
+  int n = --h->count;
+  heapEntry last = e[n];
+  int i = 0;
+  for(;;){
+    int c = 2*i + 1;
+    if(c >= n){
+      break;
     }
-  }
-  else {
-    //If queue empty, head = tail
-    if(q->tail == NULL){
-      q->head = q->tail =  t;
-      q->tail->next = NULL;
+    if(c + 1 < n && e[c+1].key < e[c].key){
+      c++;
     }
-    
-    //Otherwise, append to list
-    else{
-      q->tail->next = t;
-      q->tail = t;
-      q->tail->next = NULL;
+    if(last.key <= e[c].key){
+      break;
     }
+    e[i] = e[c];
+    i = c;
   }
+  e[i] = last;
+  return top;
 }
 
-tcb_t* rmQueue(tQueue_t *q, int tid) {
-  //Special case for all queue
-  if(q == all){
-    //If list empty, do nothing
-    if(q->head == NULL){
-      return NULL;
-    }
-    
-    //If head node matches TID, remove and return it
-    if(tid == -1 || q->head->thread_id == tid){
-      //Pop node off the front of the queue, and return it
-      tcb_t *tmp = q->head;
-      q->head = q->head->next_all;
-      if(q->head == NULL){
-        q->tail = NULL;
-      }
-      return tmp;
-    }
-    else{
-      //Loop through queue to match TID, remove and return it
-      tcb_t* tmp = q->head;
-      while(tmp->next_all != NULL){
-        if(tmp->next_all->thread_id == tid){
-          tcb_t *tmp2 = tmp->next_all;
-          if(q->tail == tmp2){
-            //If at the end, set next->next to null
-            q->tail = tmp;
-            tmp->next_all = NULL;
-          }
-          else{
-            //If not at the end, skip node being removed
-            tmp->next_all = tmp->next_all->next_all;
-          }
-          return tmp2;
-        }
-        tmp = tmp->next_all;
-      }
+void initDeque(tDeque_t *d) {
+  //Start with room for 16 threads, grown on demand
+  d->top = d->bottom = 0;
+  d->array = (dequeArray *) calloc(1,sizeof(dequeArray) + 16*sizeof(tcb_t *));
+  d->array->size = 16;
+}
+
+void pushDeque(tDeque_t *d, tcb_t *t) {
+  //Only the owning worker pushes
+  long b = __atomic_load_n(&(d->bottom),__ATOMIC_RELAXED);
+  long tp = __atomic_load_n(&(d->top),__ATOMIC_ACQUIRE);
+  dequeArray *a = __atomic_load_n(&(d->array),__ATOMIC_RELAXED);
+
+  if(b - tp > a->size - 1){
+    //Full, copy into an array twice the size; thieves may still read the old one
+    dequeArray *grown = (dequeArray *) calloc(1,sizeof(dequeArray) + 2*a->size*sizeof(tcb_t *));
+    grown->size = 2*a->size;
+    grown->retired = a;
+    long i;
+    for(i = tp; i < b; i++){
+      grown->buf[i % grown->size] = a->buf[i % a->size];
     }
+    __atomic_store_n(&(d->array),grown,__ATOMIC_RELEASE);
+    a = grown;
   }
-  
-  //All other queues
-  else {
-    //If list empty, do nothing
-    if(q->head == NULL){
+
+  __atomic_store_n(&(a->buf[b % a->size]),t,__ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&(d->bottom),b+1,__ATOMIC_RELAXED);
+}
+
+tcb_t* stealDeque(tDeque_t *d) {
+  //Take the oldest thread; the owner takes from the top too, keeping round-robin order
+  for(;;){
+    long tp = __atomic_load_n(&(d->top),__ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    long b = __atomic_load_n(&(d->bottom),__ATOMIC_ACQUIRE);
+    if(tp >= b){
       return NULL;
     }
-    
-    //If head node matches TID, remove and return it
-    if(tid == -1 || q->head->thread_id == tid){
-      //Pop node off the front of the queue, and return it
-      tcb_t *tmp = q->head;
-      q->head = q->head->next;
-      if(q->head == NULL){
-        q->tail = NULL;
-      }
+    dequeArray *a = __atomic_load_n(&(d->array),__ATOMIC_ACQUIRE);
+    tcb_t *tmp = __atomic_load_n(&(a->buf[tp % a->size]),__ATOMIC_RELAXED);
+    if(__atomic_compare_exchange_n(&(d->top),&tp,tp+1,0,__ATOMIC_SEQ_CST,__ATOMIC_RELAXED)){
       return tmp;
     }
-    else{
-      //Loop through queue to match TID and return it
-      tcb_t* tmp = q->head;
-      while(tmp->next != NULL){
-        if(tmp->next->thread_id == tid){
-          tcb_t *tmp2 = tmp->next;
-          if(q->tail == tmp2){
-            //If at the end, set next->next to null
-            q->tail = tmp;
-            tmp->next = NULL;
-          }
-          else{
-            //If not at the end, skip node being removed
-            tmp->next = tmp->next->next;
-          }
-          return tmp2;
-        }
-        tmp = tmp->next;
-      }
-    }
   }
-  
-  //If matching node not found, do nothing
-  return NULL;
 }
 
-tcb_t* findById(tQueue_t *q, int tid){
-  //Special case for all queue
-  if(q == all){
-    //If list empty, do nothing
-    if(q->head == NULL){
-      return NULL;
-    }
-    
-    //Loop over TCBs looking for a TID match to return
-    tcb_t *tmp = q->head;
-    while(tmp != NULL){
-      
-      if(tmp->thread_id == tid){
-        return tmp;
-      }
-      tmp = tmp->next_all;
-    }
-  }
-  else {
-    //If list empty, do nothing
-    if(q->head == NULL){
-      return NULL;
-    }
-    
-    //Loop over TCBs looking for a TID match to return
-    tcb_t *tmp = q->head;
-    while(tmp != NULL){
-      if(tmp->thread_id == tid){
-        return tmp;
-      }
-      tmp = tmp->next;
-    }
+void freeDeque(tDeque_t *d) {
+  //Free the array along with every one it replaced
+  dequeArray *a = d->array;
+  while(a != NULL){
+    dequeArray *tmp = a;
+    a = a->retired;
+    free(tmp);
   }
-  
-  //If nothing found, return null
-  return NULL;
-}
\ No newline at end of file
+  d->array = NULL;
+}
+
+#if defined(T_SWITCH_FAST) && defined(__x86_64__)
+/*
+ * Saved frame, from the saved stack pointer up:
+ *   mxcsr, x87 control word, r15, r14, r13, r12, rbx, rbp, return address
+ */
+__asm__(
+  ".text\n"
+  ".globl t_ctx_switch\n"
+  ".hidden t_ctx_switch\n"
+  ".type t_ctx_switch,@function\n"
+  "t_ctx_switch:\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq $8, %rsp\n"
+  "  stmxcsr (%rsp)\n"
+  "  fnstcw 4(%rsp)\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rsp\n"
+  ".Lt_ctx_restore:\n"
+  "  ldmxcsr (%rsp)\n"
+  "  fldcw 4(%rsp)\n"
+  "  addq $8, %rsp\n"
+  "  popq %r15\n"
+  "  popq %r14\n"
+  "  popq %r13\n"
+  "  popq %r12\n"
+  "  popq %rbx\n"
+  "  popq %rbp\n"
+  "  ret\n"
+  ".size t_ctx_switch, .-t_ctx_switch\n"
+  ".globl t_ctx_jump\n"
+  ".hidden t_ctx_jump\n"
+  ".type t_ctx_jump,@function\n"
+  "t_ctx_jump:\n"
+  "  movq %rdi, %rsp\n"
+  "  jmp .Lt_ctx_restore\n"
+  ".size t_ctx_jump, .-t_ctx_jump\n"
+  ".globl t_ctx_boot\n"
+  ".hidden t_ctx_boot\n"
+  ".type t_ctx_boot,@function\n"
+  "t_ctx_boot:\n"
+  "  pushq %rbp\n"
+  "  pushq %rbx\n"
+  "  pushq %r12\n"
+  "  pushq %r13\n"
+  "  pushq %r14\n"
+  "  pushq %r15\n"
+  "  subq $8, %rsp\n"
+  "  stmxcsr (%rsp)\n"
+  "  fnstcw 4(%rsp)\n"
+  "  movq %rsp, (%rdi)\n"
+  "  movq %rsi, %rdi\n"
+  "  call setcontext@PLT\n"
+  "  ud2\n"
+  ".size t_ctx_boot, .-t_ctx_boot\n"
+);
+#elif defined(T_SWITCH_FAST) && defined(__aarch64__)
+/*
+ * Saved frame, from the saved stack pointer up:
+ *   x19-x28, x29 (fp), x30 (lr), d8-d15, fpcr
+ */
+__asm__(
+  ".text\n"
+  ".globl t_ctx_switch\n"
+  ".hidden t_ctx_switch\n"
+  ".type t_ctx_switch,%function\n"
+  "t_ctx_switch:\n"
+  "  sub sp, sp, #176\n"
+  "  stp x19, x20, [sp, #0]\n"
+  "  stp x21, x22, [sp, #16]\n"
+  "  stp x23, x24, [sp, #32]\n"
+  "  stp x25, x26, [sp, #48]\n"
+  "  stp x27, x28, [sp, #64]\n"
+  "  stp x29, x30, [sp, #80]\n"
+  "  stp d8, d9, [sp, #96]\n"
+  "  stp d10, d11, [sp, #112]\n"
+  "  stp d12, d13, [sp, #128]\n"
+  "  stp d14, d15, [sp, #144]\n"
+  "  mrs x9, fpcr\n"
+  "  str x9, [sp, #160]\n"
+  "  mov x9, sp\n"
+  "  str x9, [x0]\n"
+  "  mov sp, x1\n"
+  ".Lt_ctx_restore:\n"
+  "  ldr x9, [sp, #160]\n"
+  "  msr fpcr, x9\n"
+  "  ldp x19, x20, [sp, #0]\n"
+  "  ldp x21, x22, [sp, #16]\n"
+  "  ldp x23, x24, [sp, #32]\n"
+  "  ldp x25, x26, [sp, #48]\n"
+  "  ldp x27, x28, [sp, #64]\n"
+  "  ldp x29, x30, [sp, #80]\n"
+  "  ldp d8, d9, [sp, #96]\n"
+  "  ldp d10, d11, [sp, #112]\n"
+  "  ldp d12, d13, [sp, #128]\n"
+  "  ldp d14, d15, [sp, #144]\n"
+  "  add sp, sp, #176\n"
+  "  ret\n"
+  ".size t_ctx_switch, .-t_ctx_switch\n"
+  ".globl t_ctx_jump\n"
+  ".hidden t_ctx_jump\n"
+  ".type t_ctx_jump,%function\n"
+  "t_ctx_jump:\n"
+  "  mov sp, x0\n"
+  "  b .Lt_ctx_restore\n"
+  ".size t_ctx_jump, .-t_ctx_jump\n"
+  ".globl t_ctx_boot\n"
+  ".hidden t_ctx_boot\n"
+  ".type t_ctx_boot,%function\n"
+  "t_ctx_boot:\n"
+  "  sub sp, sp, #176\n"
+  "  stp x19, x20, [sp, #0]\n"
+  "  stp x21, x22, [sp, #16]\n"
+  "  stp x23, x24, [sp, #32]\n"
+  "  stp x25, x26, [sp, #48]\n"
+  "  stp x27, x28, [sp, #64]\n"
+  "  stp x29, x30, [sp, #80]\n"
+  "  stp d8, d9, [sp, #96]\n"
+  "  stp d10, d11, [sp, #112]\n"
+  "  stp d12, d13, [sp, #128]\n"
+  "  stp d14, d15, [sp, #144]\n"
+  "  mrs x9, fpcr\n"
+  "  str x9, [sp, #160]\n"
+  "  mov x9, sp\n"
+  "  str x9, [x0]\n"
+  "  mov x0, x1\n"
+  "  bl setcontext\n"
+  "  brk #1000\n"
+  ".size t_ctx_boot, .-t_ctx_boot\n"
+);
+#endif
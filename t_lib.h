@@ -2,6 +2,7 @@
  * types used by thread library
  */
 #define _XOPEN_SOURCE 500
+#define _DEFAULT_SOURCE 1 //syscall(), for per-thread timers
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -11,39 +12,337 @@
 #include <sys/types.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <linux/futex.h>
+
+/*
+ * Context switch selection: on x86-64 and AArch64 threads switch by saving
+ * only the callee-saved registers and the stack pointer. Build with
+ * -DT_SWITCH_UCONTEXT to force the portable swapcontext() path instead.
+ * ucontext_t is still used to bootstrap a new thread in t_create().
+ */
+#if !defined(T_SWITCH_UCONTEXT) && (defined(__x86_64__) || defined(__aarch64__))
+#define T_SWITCH_FAST 1
+#endif
+
+//Thread stacks are mmap()ed with a PROT_NONE guard page below them, and
+//recycled through a pool instead of unmapped when a thread terminates
+#define STACK_SIZE 0x10000   // usable bytes per stack
+#define STACK_POOL_WARM 16   // stacks mapped ahead by t_init()
+#define STACK_POOL_MAX 1024  // free stacks kept for reuse, the rest are unmapped
+#define STACK_MIN 0x2000     // smallest stack t_create_ex() will map
+#define STACK_GROW_SIZE 0x100000 // reserved for a T_GROWABLE stack
+
+#define T_NAME_LEN 16
+
+//Exited threads are kept as zombies until joined; their stacks are freed
+//this many at a time, or when a worker goes idle
+#define REAP_BATCH 32
+
+//Thread attribute flags
+#define T_PINNED 0x1         // always run on the worker that created it
+#define T_GROWABLE 0x2       // reserve STACK_GROW_SIZE, backed only as it is touched
+#define T_DETACHED 0x4       // cannot be joined, freed as soon as it exits
+
+//Scheduling classes for t_attr_t.policy; T_SCHED_FAIR threads share the
+//processor by virtual runtime, and run only when no T_SCHED_RR thread is ready
+#define T_SCHED_RR 0
+#define T_SCHED_FAIR 1
+#define T_SCHED_MLFQ 2     // round-robin, but the level moves with behaviour, see MLFQ_DEPTH
+#define T_SCHED_EDF 3      // periodic, from t_create_periodic(); ahead of every other class
+
+//Exit value of a thread ended by t_cancel() or t_group_cancel()
+#define T_CANCELED ((void *) -1)
+
+//Longest wait-for cycle t_deadlock_detect() passes on to its report function
+#define T_DEADLOCK_MAX 64
+
+typedef struct t_group_t
+{
+  //Threads created into the group, waited for or cancelled together
+  int *tids;                 // member ids, in creation order
+  int count, cap;
+} t_group_t;
+
+typedef struct t_attr_t
+{
+  //Attributes for t_create_ex(), set to defaults by t_attr_init()
+  int thread_id;             // -1 gets a handle, see T_HANDLE
+  int priority;              // 0 is the highest
+  size_t stack_size;         // rounded up to whole pages
+  const char *name;          // copied, truncated to T_NAME_LEN-1 chars
+  int flags;                 // T_PINNED, T_GROWABLE, T_DETACHED
+  t_group_t *group;          // group to join, NULL for none
+  int policy;                // T_SCHED_RR, T_SCHED_FAIR or T_SCHED_MLFQ
+} t_attr_t;
+
+typedef struct t_periodic_stats_t
+{
+  //Timing of a periodic thread, filled in by t_periodic_stats()
+  long jobs;                 // jobs released
+  long misses;               // jobs that finished past their deadline or ran out of budget
+  long throttled;            // jobs stopped until the next period for running out of budget
+  long max_jitter;           // usec, latest a job started after its release
+  long avg_jitter;           // usec
+} t_periodic_stats_t;
+
+typedef struct t_stack_stats_t
+{
+  //Stack memory, filled in by t_stack_stats() and t_stack_stats_total()
+  size_t reserved;           // mapped address space, less guard pages
+  size_t committed;          // bytes in resident pages
+  size_t high_water;         // deepest resident page, from the top of the stack
+} t_stack_stats_t;
+
+typedef struct tLink
+{
+  //Intrusive list node, embedded in what it links
+  struct tLink *prev, *next;
+} tLink;
+
+#define CACHE_LINE 64
+
+typedef struct tPeriodic
+{
+  //T_SCHED_EDF job timing, in ns; only periodic threads have one
+  void (*fn)(void *);        // run once per job
+  void *arg;
+  long long period, budget, rel_deadline;
+  long long release;         // when the current job was released
+  long long deadline;        // absolute deadline of the current job, the EDF key
+  int used;                  // ticks run by the current job, checked against budget
+  int throttled;             // out of budget, waiting for the next period
+  long jobs, misses, throttles;
+  long long jitter_max, jitter_sum;
+} tPeriodic;
+
+typedef struct tcbCold
+{
+  //Parts of a thread the scheduler does not touch on a switch
+  ucontext_t context;        // full register and FP state, used to start the thread
+                             // and by the swapcontext() path
+  void (*thread_fn)(int);    // entry point from t_create(), passed the thread id
+  void (*thread_entry)(void *); // entry point from t_create_ex(), passed thread_arg
+  void *thread_arg;
+  struct mbox *mail;
+  char name[T_NAME_LEN];
+  int slot;                  // index in the thread table
+  void *exit_value;          // passed to t_exit()
+  struct sem_t *exited;      // joiners wait here, created by the first t_join()
+  int joiners;               // threads blocked in t_join() on this one
+  int detached;              // freed as soon as it exits and is reaped
+  int reaped;                // stack already freed by the reaper
+  struct sem_t *waiting_on;  // semaphore it is blocked on, for cancellation
+  t_group_t *group;          // group it was created into, NULL for none
+  long long vruntime;        // T_SCHED_FAIR: weighted ns run, see FAIR_WEIGHT_0
+  long ready_tick;           // T_SCHED_MLFQ: worker tick it was last made ready at
+  tPeriodic *rt;             // T_SCHED_EDF: period, budget and statistics
+  int base_priority;         // priority it was created with, before inheritance
+  struct sem_t *held;        // mutexes it owns, see sem_init_mutex()
+  int wait_level;            // SEM_PRIO: level it is queued on a semaphore at
+  int wait_for;              // tid it is blocked on in t_join(), block_send() or receive(), 0 for none
+  int dl_mark;               // stamp of the last findCycle() walk through it
+  int dl_reported;           // in a wait-for cycle already reported, until woken
+  struct sem_t **any_sems;   // sem_wait_any(): the semaphores it waits on
+  struct tcb_t **any;        // sem_wait_any(): its T_PROXY stand-in on each, NULL if not waiting
+  int nany;
+  int any_index;             // sem_wait_any(): which one it got, -1 until signalled
+  int in_handler;            // inside sig_handler(), maybe switched off there
+} tcbCold;
 
 typedef struct tcb_t
 {
-  //TCB containing all relevant information about the thread
+  //TCB with the fields used on every switch, in one cache line
+  void *saved_sp;            // stack pointer saved by t_ctx_switch, NULL until first run
+  tLink link;                // membership in a wait queue or inbox
+  struct tQueue_t *queue;    // queue linked on, NULL if none
+  tcbCold *cold;
   int thread_id;
-  int thread_priority;
-  ucontext_t *thread_context;
-  struct mbox *mail;
-	struct tcb_t *next;
-	struct tcb_t *next_all;
+  int thread_priority;       // effective: base_priority, or inherited from a waiter
+  int pinned_worker;         // worker that must run this thread, -1 for any
+  short slice_used;          // timer ticks run since it last yielded, negative
+                             // for slice carried over from before
+  short quantum;             // ticks per slice from t_set_quantum(), 0 for the default
+  short carry;               // most ticks it may carry over, see t_set_carry()
+  short state;               // T_LIVE, T_CANCELING, or T_ZOMBIE once exited
+  signed char policy;        // T_SCHED_RR, T_SCHED_FAIR or T_SCHED_MLFQ
+  signed char depth;         // T_SCHED_MLFQ: levels sunk below its priority, negative when aged above
+  unsigned short ready_gen;  // odd while on a ready deque, see pushReady()
 } tcb_t;
 
+#define T_LIVE 0
+#define T_ZOMBIE 1
+#define T_CANCELING 2        // cancelled, exits at the next cancellation point
+#define T_PROXY 3            // not a thread: queued on a semaphore for one in sem_wait_any()
+
+_Static_assert(sizeof(tcb_t) <= CACHE_LINE, "tcb_t must fit in one cache line");
+
+//Ready deque entries carry their push's ready_gen in the tcb's low bits
+#define READY_TAG (CACHE_LINE - 1)
+#define READY_TCB(e) ((tcb_t *) ((uintptr_t) (e) & ~(uintptr_t) READY_TAG))
+
+//tcb_t holding a link
+#define LINK_TCB(l) ((tcb_t *) ((char *) (l) - offsetof(tcb_t, link)))
+
 typedef struct tQueue_t
 {
-  //pointers to start and end of list
-  tcb_t *head, *tail;
+  //Circular doubly-linked list of tcbs; head.next is the first, head.prev the last
+  tLink head;
 } tQueue_t;
 
+//Ids handed out by t_create_ex() are handles: T_HANDLE, then the slot's
+//generation, then the slot index
+#define T_HANDLE 0x40000000
+#define T_SLOT_BITS 17
+#define T_SLOT_MASK ((1 << T_SLOT_BITS) - 1)
+#define T_GEN_MASK ((1 << (30 - T_SLOT_BITS)) - 1)
+
+typedef struct threadSlot
+{
+  tcb_t *tcb;                // live thread in this slot, NULL when free
+  unsigned int gen;          // bumped each time the slot is freed
+  int next_free;             // next slot on the free list, -1 ends it
+} threadSlot;
+
+//Open-addressing index from tid to slot
+#define TID_EMPTY -1
+#define TID_DELETED -2
+
+typedef struct tidEntry
+{
+  int tid;
+  int slot;                  // TID_EMPTY or TID_DELETED when not in use
+} tidEntry;
+
+//Priority levels, 0 is the highest; larger priorities share the lowest level
+#define PRIO_LEVELS 64
+
+typedef struct dequeArray
+{
+  long size;
+  struct dequeArray *retired; // smaller array it replaced, freed at shutdown
+  tcb_t *buf[];
+} dequeArray;
+
+typedef struct tDeque_t
+{
+  //Chase-Lev deque: the owner pushes at bottom, anyone takes from top
+  volatile long top, bottom;
+  dequeArray *array;
+} tDeque_t;
+
+//Fair class: a thread at the default priority 1 has weight FAIR_WEIGHT_0,
+//and each level up weighs 1.25 times more; vruntime advances by real time
+//scaled by FAIR_WEIGHT_0/weight
+#define FAIR_WEIGHT_0 1024
+#define FAIR_WEIGHT_MIN 15
+#define FAIR_WAKEUP_GRAN 1000000     // ns of vruntime a woken thread must lead by to preempt
+#define FAIR_SLEEPER_CREDIT 5000000  // ns below fair_min a woken thread may be placed
+#define FAIR_LATENCY 6000            // usec in which every ready fair thread should run
+#define FAIR_MIN_SLICE 1000          // usec, shortest fair slice
+
+//MLFQ class: a thread runs at its priority plus its depth. Using a whole
+//slice sinks it a level, blocking before the end raises it one, and waiting
+//MLFQ_AGE on one level raises it too, even above its priority, so a busy
+//higher level cannot starve it. The slice doubles with each level sunk.
+#define MLFQ_DEPTH 4
+#define MLFQ_QUANTUM 2000            // usec, slice at depth 0
+#define MLFQ_AGE 20000               // usec ready on one level before it is raised
+
+#define NO_RELEASE LLONG_MAX
+
+typedef struct heapEntry
+{
+  long long key;            // copied, so sifting never touches cold blocks
+  tcb_t *t;
+} heapEntry;
+
+typedef struct tHeap
+{
+  //Binary min-heap of ready threads, guarded by a spin lock like the inbox
+  heapEntry *entries;
+  volatile int count;
+  int cap;
+  volatile int lock;
+} tHeap;
+
+typedef struct worker_t
+{
+  //Kernel thread running its own scheduler loop
+  int id;
+  pthread_t pthread;
+  tcb_t *current;           // green thread running on this worker
+  tcb_t *idle;              // context of the worker's scheduler loop
+  tQueue_t *zombies;        // threads that exited here, their stacks not yet freed
+  int nzombies;
+  tcb_t *requeue;           // thread switched away from, made ready once saved
+  tcb_t *donor;             // handed its slice to the running thread, see handoffTo()
+  int unlock_pending;       // scheduler lock to release once switched
+  tDeque_t ready[PRIO_LEVELS]; // ready threads, one deque per level
+  volatile unsigned long long ready_bits; // bit n set when level n may be non-empty
+  tQueue_t *inbox;          // threads pinned here, queued by other workers
+  volatile int inbox_lock;
+  tHeap fair;               // ready T_SCHED_FAIR threads, keyed on vruntime
+  tHeap edf;                // released T_SCHED_EDF threads, keyed on deadline
+  tQueue_t *sleepers;       // T_SCHED_EDF threads waiting for release, soonest first
+  volatile long long next_release; // release of the first sleeper, NO_RELEASE if none
+  long long fair_min;       // vruntime floor for threads placed on this worker
+  long long run_start;      // when the running T_SCHED_FAIR thread was switched in
+  volatile long ticks;      // tick timer expirations on this worker
+  long aged_at;             // ticks when MLFQ threads were last aged
+  volatile int preempt_off;     // nesting depth of no-preemption sections
+  volatile int preempt_pending; // SIGALRM arrived while preemption was off
+  volatile int deadlock_pending; // tick found a deadlock check due, see preemptOn()
+  timer_t tick_timer;       // periodic SIGALRM aimed at this kernel thread
+  volatile int ticking;     // tick_timer armed, 0 while tickless
+  volatile int parked;      // asleep in parkWorker()
+  volatile int wake_seq;    // futex it sleeps on, bumped by wakeWorker()
+} worker_t;
+
+//Order a semaphore wakes its waiters in, given to sem_init_ex()
+#define SEM_FIFO 0
+#define SEM_PRIO 1           // highest priority first, FIFO among equals
+
+typedef struct waitLevels
+{
+  //Last waiter queued at each priority level, with a bit set per level in
+  //use, so a waiter is linked in after the last of its level in O(1)
+  unsigned long long bits;
+  tcb_t *tail[PRIO_LEVELS];
+} waitLevels;
+
 typedef struct sem_t
 {
   int count;
   tQueue_t *q;
+  waitLevels *levels;        // SEM_PRIO only, NULL for FIFO
+  int mutex;                 // owner-tracking, from sem_init_mutex()
+  tcb_t *owner;              // mutex: thread holding it, NULL when free
+  struct sem_t *next_held;   // mutex: next one on its owner's held list
+  int binary;                // created with a count of 1, so used as a lock
+  int holder;                // binary: tid of the thread that last took it, 0 when free
 } sem_t;
 
+//Messages up to this length, with the terminator, are kept inside their
+//messageNode, which then fills two cache lines
+#define MSG_INLINE 88
+
 typedef struct messageNode
 {
-  char *message;            // copy of the message
+  char *message;            // copy of the message, inline_msg if it fits
   int len;                  // length of the message
   int sender;               // TID of the sender thread
   int receiver;             // TID of the receiver thread
   sem_t *recv_wait;          // Threads waiting for message to be received
   struct messageNode *next; // pointer to next node
+  char inline_msg[MSG_INLINE];
 } messageNode;
 
 typedef struct mbox
@@ -53,18 +352,77 @@ typedef struct mbox
   sem_t *mbox_recv; // threads waiting to receive from mailbox
 } mbox;
 
+//Library structures come from per-type free lists of cache-line aligned
+//objects, carved out of SLAB_CHUNK byte chunks
+#define SLAB_CHUNK 0x4000
+
+enum { SLAB_TCB, SLAB_COLD, SLAB_SEM, SLAB_QUEUE, SLAB_MBOX, SLAB_MESSAGE, SLAB_TYPES };
+
+typedef struct slab_t
+{
+  const char *name;
+  size_t size;              // object size before rounding to cache lines
+  void *free;               // free objects, linked through their first word
+  void *chunks;             // chunks, linked through their first word
+  long nchunks;
+  long allocs;              // objects handed out
+  long reused;              // of those, taken from the free list without malloc
+  long live;                // handed out and not yet freed
+} slab_t;
+
+typedef struct t_slab_stats_t
+{
+  //Counters for one slab, filled in by t_slab_stats()
+  const char *name;
+  long allocs;
+  long reused;
+  long live;
+  long chunks;
+} t_slab_stats_t;
+
 //External Funtions
 
 //Thread library fns
 void t_init();
+void t_init_workers(int nworkers);
 void t_create(void(*function)(int), int thread_id, int priority);
+int t_create_ex(void(*function)(void *), void *arg, const t_attr_t *attr);
+void t_attr_init(t_attr_t *attr);
 void t_yield();
+int t_yield_to(int tid);
+void t_set_handoff(int on);
 void t_terminate();
+void t_exit(void *value);
+int t_join(int tid, void **value);
+void t_detach(int tid);
+int t_create_periodic(void (*function)(void *), void *arg, long period, long budget, long deadline);
+int t_periodic_stats(int tid, t_periodic_stats_t *st);
+void t_cancel(int tid);
+int t_set_quantum(int tid, long usec);
+int t_set_carry(int tid, long usec);
+void t_set_priority_quantum(int priority, long usec);
+void t_set_default_quantum(long usec);
 void t_shutdown();
+void t_warm_stacks(int n);
+int t_stack_stats(int tid, t_stack_stats_t *st);
+void t_stack_stats_total(t_stack_stats_t *st);
+int t_slab_stats(t_slab_stats_t *st, int max);
+int t_deadlock_check(int *tids, int max);
+void t_deadlock_detect(long usec, void (*report)(const int *tids, int n));
+
+//Thread group fns
+void t_group_init(t_group_t **g);
+int t_group_wait(t_group_t *g);
+int t_group_cancel(t_group_t *g);
+void t_group_destroy(t_group_t **g);
 
 //Semaphore fns
 void sem_init(sem_t **sp, int sem_count);
+void sem_init_ex(sem_t **sp, int sem_count, int order);
+void sem_init_mutex(sem_t **sp);
 void sem_wait(sem_t *sp);
+int sem_wait_all(sem_t **sems, int n);
+void sem_wait_any(sem_t **sems, int n, int *index);
 void sem_signal(sem_t *sp);
 void sem_destroy(sem_t **sp);
 
@@ -83,11 +441,158 @@ void block_receive(int *tid, char *msg, int *len);
 //Internal Functions
 
 //Internal scheduling fns
-void sig_handler();
+void sig_handler(int sig, siginfo_t *info, void *ctx);
+void handleTick(worker_t *w, siginfo_t *info);
 void init_alarm();
+void initTick(worker_t *w);
+void setTick(worker_t *w, long usec);
+void stopTick(worker_t *w);
+void wakeTick(worker_t *w);
+int anyReady(worker_t *w);
+int anyRunnable(worker_t *w);
+void preemptOff();
+void preemptOn();
+void lockSched();
+void unlockSched();
+void acquireSched();
+void releaseSched();
+worker_t* curWorker();
+tcb_t* pickNext(worker_t *w);
+tcb_t* takeInbox(worker_t *w, int level);
+tcb_t* pickFair(worker_t *w);
+tcb_t* takeFair(worker_t *from, worker_t *into);
+void pushFair(worker_t *w, tcb_t *t);
+int sliceTicks(worker_t *w, tcb_t *t);
+int carriedSlice(worker_t *w, tcb_t *t);
+short usecTicks(long usec);
+void ageLevels(worker_t *w);
+tcb_t* pickEdf(worker_t *w);
+tcb_t* pickBlocking(worker_t *w);
+void releaseDue(worker_t *w);
+void sleepThread(worker_t *w, tcb_t *t);
+int edfKeeps(tcb_t *cur, tcb_t *next);
+void periodicMain(void *arg);
+void waitPeriod();
+void mlfqBlock(tcb_t *t);
+int fairWeight(tcb_t *t);
+void chargeSwitch(worker_t *w, tcb_t *from, tcb_t *to);
+long long nowNs();
+
+//Internal heap fns, callers hold the heap's lock
+void initHeap(tHeap *h);
+void lockHeap(tHeap *h);
+void unlockHeap(tHeap *h);
+void pushHeap(tHeap *h, long long key, tcb_t *t);
+heapEntry popHeap(tHeap *h);
+tcb_t* takeLevel(worker_t *w, int level);
+int readyLevel(worker_t *w);
+int inboxLevel(worker_t *w);
+void makeReady(tcb_t *t);
+int prioLevel(tcb_t *t);
+void pushReady(worker_t *w, tcb_t *t);
+int requeueReady(worker_t *w, tcb_t *t);
+void pushTagged(worker_t *w, tcb_t *t, unsigned short g);
+tcb_t* claimReady(tcb_t *e);
+void switchTo(worker_t *w, tcb_t *from, tcb_t *to);
+void finishSwitch();
+void freeThread(tcb_t *t);
+void reapZombies(worker_t *w);
+void releaseZombie(tcb_t *t);
+void reapThread(tcb_t *t);
+void yieldThread();
+int handoffTo(worker_t *w, tcb_t *t);
+void handoffWoken(tcb_t *t);
+int claimThread(tcb_t *t);
+void exitThread(void *value);
+int joinThread(tcb_t *t, void **value);
+void cancelThread(tcb_t *t);
+void testCancel();
+void cancelExit();
+void groupAdd(t_group_t *g, int tid);
+void* workerMain(void *arg);
+void workerLoop(worker_t *w);
+void parkWorker(worker_t *w);
+void wakeWorker(worker_t *w);
+void wakeParked(worker_t *w);
+int anyBlocked();
+void deadlocked();
+tcb_t* waitsFor(tcb_t *t);
+tcb_t* semHolder(sem_t *sp);
+int findCycle(int *tids, int max, int fresh);
+void checkDeadlocks();
+void printCycle(const int *tids, int n);
+void idleStart();
+int createThread(const t_attr_t *attr, void (*fct)(int), void (*entry)(void *), void *arg);
+
+//Internal stack pool fns, called with the scheduler lock held
+void* allocStack(size_t size);
+void freeStack(void *sp, size_t size);
+void* mapStack(size_t size);
+void warmStacks(int n);
+void drainStacks();
+void stackUsage(void *sp, size_t size, t_stack_stats_t *st);
+
+//Internal slab fns, called with the scheduler lock held
+void* slabAlloc(int type);
+void slabFree(int type, void *p);
+size_t slabSize(slab_t *sl);
+void growSlab(slab_t *sl);
+void drainSlabs();
+
+//Internal semaphore and mailbox fns, called with the scheduler lock held
+void semInit(sem_t **sp, int sem_count);
+int semWait(sem_t *sp);
+int semWaitFor(sem_t *sp, int tid);
+int semWaitAll(sem_t **sems, int n);
+int semWaitAny(sem_t **sems, int n, int *index);
+tcb_t* wakeAny(tcb_t *p);
+void dropProxies(tcbCold *c);
+void chargeBlock(worker_t *w, tcb_t *t);
+void blockThread(worker_t *w, tcb_t *t);
+tcb_t* semSignal(sem_t *sp);
+void semDestroy(sem_t **sp);
+sem_t* blockedOn(tcb_t *t);
+void addWaiter(sem_t *sp, tcb_t *t);
+tcb_t* rmWaiter(sem_t *sp);
+void unlinkWaiter(sem_t *sp, tcb_t *t);
+void takeMutex(sem_t *sp, tcb_t *t);
+void dropMutex(sem_t *sp);
+void inheritPriority(tcb_t *t);
+void mboxCreate(mbox **mb);
+void mboxDestroy(mbox **mb);
+messageNode* newMessage(char *msg, int len, int receiver);
+int appendMessage(mbox *mb, messageNode *new_msg, tcb_t **woken);
+void freeMessage(messageNode *m);
+
+//Internal context switch fns
+void t_start();
+void ctx_switch(tcb_t *from, tcb_t *to);
+void ctx_jump(tcb_t *to);
 
 //Internal queueing fns
 tQueue_t* createQueue();
 void addQueue(tQueue_t *q, tcb_t *t);
+void insertQueue(tQueue_t *q, tcb_t *after, tcb_t *t);
 tcb_t* rmQueue(tQueue_t *q, int tid);
 tcb_t* findById(tQueue_t *q, int tid);
+void unlinkQueue(tQueue_t *q, tcb_t *t);
+tcb_t* queueHead(tQueue_t *q);
+tcb_t* queueNext(tQueue_t *q, tcb_t *t);
+
+//Internal thread table fns, called with the scheduler lock held
+void initThreadTable();
+void freeThreadTable();
+void addThread(tcb_t *t, int handle);
+void removeThread(tcb_t *t);
+tcb_t* findThread(int tid);
+unsigned int hashTid(int tid);
+int lookupTid(int tid);
+void indexTid(int tid, int slot);
+void unindexTid(int tid);
+void rehashTids(int cap);
+
+//Internal work-stealing deque fns
+void initDeque(tDeque_t *d);
+void pushDeque(tDeque_t *d, tcb_t *t);
+tcb_t* stealDeque(tDeque_t *d);
+void freeDeque(tDeque_t *d);
@@ -0,0 +1,55 @@
+/*
+ * Test Program #12 - Context Switch Cost
+ *
+ * Two threads ping-pong with t_yield(), and the average cost of one
+ * switch is reported. Build as test12 (register-only switch) and
+ * test12-ucontext (swapcontext path) to compare the two.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define SWITCHES 1000000
+
+int done = 0;
+
+void ponger(int val) {
+
+   while (!done) {
+      t_yield();
+   }
+
+   printf("Thread %d is done...\n", val);
+   t_terminate();
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, n = SWITCHES;
+   struct timespec start, end;
+
+   if (argc == 2) {
+      n = atoi(argv[1]);
+   }
+
+   t_init();
+   t_create(ponger, 1, 1);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < n; i++) {
+      t_yield();
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   done = 1;
+   t_yield();
+
+   double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+   printf("%d yields, %.1f ns per switch\n", n, ns / (2.0 * n));
+
+   t_shutdown();
+
+   return 0;
+}
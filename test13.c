@@ -0,0 +1,94 @@
+/*
+ * Test Program #13 - M:N Scheduling
+ *
+ * CPU-bound threads run across several kernel workers, update a shared
+ * total under a semaphore, and report back to main with send(). Main
+ * waits on the done semaphore before reading its mailbox.
+ *
+ * USAGE: ./test13 <workers> <threads>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define WORK 20000000
+
+sem_t *mutex;
+sem_t *done;
+long long total = 0;
+
+void cruncher(int val) {
+
+   long long i, sum = 0;
+   char msg[32];
+
+   for (i = 0; i < WORK; i++) {
+      sum += i % 7;
+      if (i % 1000000 == 0) {
+         t_yield();
+      }
+   }
+
+   sem_wait(mutex);
+   total += sum;
+   sem_signal(mutex);
+
+   sprintf(msg, "thread %d done", val);
+   send(-1, msg, strlen(msg));
+   sem_signal(done);
+
+   t_terminate();
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, nworkers = 4, nthreads = 8;
+   struct timespec start, end;
+
+   if (argc == 3) {
+      nworkers = atoi(argv[1]);
+      nthreads = atoi(argv[2]);
+   }
+
+   t_init_workers(nworkers);
+   sem_init(&mutex, 1);
+   sem_init(&done, 0);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 1; i <= nthreads; i++) {
+      t_create(cruncher, i, 1);
+   }
+
+   for (i = 0; i < nthreads; i++) {
+      sem_wait(done);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   for (i = 0; i < nthreads; i++) {
+      int who = 0, len;
+      char msg[1024];
+      receive(&who, msg, &len);
+      if (len) {
+         printf("main got [%s] from %d\n", msg, who);
+      }
+   }
+
+   long long expect = 0;
+   for (i = 0; i < WORK; i++) {
+      expect += i % 7;
+   }
+   expect *= nthreads;
+
+   printf("total %lld (%s), %d workers, %.3f s\n", total,
+          total == expect ? "ok" : "WRONG", nworkers,
+          (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+   sem_destroy(&done);
+   sem_destroy(&mutex);
+   t_shutdown();
+
+   return 0;
+}
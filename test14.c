@@ -0,0 +1,89 @@
+/*
+ * Test Program #14 - Fan-out Fibonacci
+ *
+ * Each thread computing fib(n) spawns two children for fib(n-1) and
+ * fib(n-2), down to a sequential cutoff, and waits for them on a
+ * semaphore. Thread ids number the call tree like a heap (children of
+ * i are 2i and 2i+1). Run with different worker counts to see how the
+ * work-stealing run queues scale.
+ *
+ * USAGE: ./test14 <workers> <n>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define CUTOFF 24
+#define MAX_NODES (1 << 16)
+
+int arg[MAX_NODES];
+long long result[MAX_NODES];
+sem_t *done[MAX_NODES];
+
+long long fib(int n) {
+
+   if (n < 2) {
+      return n;
+   }
+   return fib(n-1) + fib(n-2);
+}
+
+void fib_thread(int id) {
+
+   int n = arg[id];
+
+   if (n < CUTOFF || 2*id+1 >= MAX_NODES) {
+      result[id] = fib(n);
+   }
+   else {
+      //fan out, then wait for both children
+      sem_init(&done[id], 0);
+      arg[2*id] = n-1;
+      arg[2*id+1] = n-2;
+      t_create(fib_thread, 2*id, 1);
+      t_create(fib_thread, 2*id+1, 1);
+      sem_wait(done[id]);
+      sem_wait(done[id]);
+      sem_destroy(&done[id]);
+      result[id] = result[2*id] + result[2*id+1];
+   }
+
+   if (id > 1) {
+      sem_signal(done[id/2]);
+   }
+   else {
+      sem_signal(done[0]);
+   }
+   t_terminate();
+}
+
+int main(int argc, char *argv[]) {
+
+   int nworkers = 4, n = 36;
+   struct timespec start, end;
+
+   if (argc == 3) {
+      nworkers = atoi(argv[1]);
+      n = atoi(argv[2]);
+   }
+
+   t_init_workers(nworkers);
+   sem_init(&done[0], 0);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   arg[1] = n;
+   t_create(fib_thread, 1, 1);
+   sem_wait(done[0]);
+   clock_gettime(CLOCK_MONOTONIC, &end);
+
+   printf("fib(%d) = %lld (%s), %d workers, %.3f s\n", n, result[1],
+          result[1] == fib(n) ? "ok" : "WRONG", nworkers,
+          (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+   sem_destroy(&done[0]);
+   t_shutdown();
+
+   return 0;
+}
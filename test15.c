@@ -0,0 +1,73 @@
+/*
+ * Test Program #15 - Multi-level Priorities
+ *
+ * Threads on four priority levels (0 control, 1 RPC, 2 batch and
+ * 3 background) each yield a few times. t_yield() hands the CPU to the
+ * best other ready thread, so levels 2 and 3 only run once levels 0
+ * and 1 are done.
+ */
+
+#include <stdio.h>
+#include "ud_thread.h"
+
+int priority[5] = { -1, 3, 2, 1, 0 };
+sem_t *done;
+
+void thread_function(int val) {
+
+   int i;
+
+   for (i = 0; i < 3; i++) {
+      printf("I am thread %d (priority %d) [%d]...\n", val, priority[val], i);
+      t_yield();
+   }
+
+   sem_signal(done);
+   t_terminate();
+}
+
+int main(void) {
+
+   int i;
+
+   t_init();
+   sem_init(&done, 0);
+
+   for (i = 1; i <= 4; i++) {
+      t_create(thread_function, i, priority[i]);
+   }
+
+   for (i = 0; i < 3; i++) {
+      printf("I am main (priority 1) [%d]...\n", i);
+      t_yield();
+   }
+
+   for (i = 1; i <= 4; i++) {
+      sem_wait(done);
+   }
+
+   printf("All threads done...\n");
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
+
+/* --- output -----
+I am main (priority 1) [0]...
+I am thread 4 (priority 0) [0]...
+I am thread 3 (priority 1) [0]...
+I am thread 4 (priority 0) [1]...
+I am main (priority 1) [1]...
+I am thread 4 (priority 0) [2]...
+I am thread 3 (priority 1) [1]...
+I am main (priority 1) [2]...
+I am thread 3 (priority 1) [2]...
+I am thread 2 (priority 2) [0]...
+I am thread 1 (priority 3) [0]...
+I am thread 2 (priority 2) [1]...
+I am thread 1 (priority 3) [1]...
+I am thread 2 (priority 2) [2]...
+I am thread 1 (priority 3) [2]...
+All threads done...
+*/
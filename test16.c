@@ -0,0 +1,67 @@
+/*
+ * Test Program #16 - Uncontended Semaphore Cost
+ *
+ * Times sem_wait()/sem_signal() pairs on a semaphore nobody else uses,
+ * and a send()/receive() round trip to the calling thread's own mailbox.
+ * Neither ever blocks, so this is the cost of the calls themselves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define PAIRS 1000000
+
+double elapsed(struct timespec *start, struct timespec *end) {
+
+   return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, n = PAIRS;
+   struct timespec start, end;
+   sem_t *s;
+
+   if (argc == 2) {
+      n = atoi(argv[1]);
+   }
+
+   t_init();
+   sem_init(&s, 1);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < n; i++) {
+      sem_wait(s);
+      sem_signal(s);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   printf("sem_wait/sem_signal: %.1f ns per pair\n", elapsed(&start, &end) / n);
+
+   char *msg = "ping";
+   char buf[16];
+   int len, who;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < n / 10; i++) {
+      who = 0;
+      send(-1, msg, strlen(msg));
+      receive(&who, buf, &len);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   printf("send/receive: %.1f ns per round trip\n", elapsed(&start, &end) / (n / 10));
+
+   //Allocations served from the slab free lists instead of malloc
+   t_slab_stats_t st[SLAB_TYPES];
+   int k, slabs = t_slab_stats(st, SLAB_TYPES);
+   for (k = 0; k < slabs; k++) {
+      printf("%-12s %9ld allocs, %9ld reused\n", st[k].name, st[k].allocs, st[k].reused);
+   }
+
+   sem_destroy(&s);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Test Program #17 - Thread Churn
+ *
+ * Creates and terminates short-lived threads in batches, so the cost per
+ * thread is dominated by t_create()/t_terminate() and stack allocation.
+ * Usage: ./test17 [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define THREADS 1000000
+#define BATCH 64
+
+sem_t *done;
+
+double elapsed(struct timespec *start, struct timespec *end) {
+
+   return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+void thread_function(int val) {
+
+   (void) val;
+   sem_signal(done);
+   t_terminate();
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, j, n = THREADS;
+   struct timespec start, end;
+
+   if (argc == 2) {
+      n = atoi(argv[1]);
+   }
+
+   t_init();
+   t_warm_stacks(BATCH);
+   sem_init(&done, 0);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < n; i += BATCH) {
+      //Ids are reused once the previous batch has terminated
+      for (j = 0; j < BATCH && i + j < n; j++) {
+         t_create(thread_function, j + 1, 1);
+      }
+      for (j = 0; j < BATCH && i + j < n; j++) {
+         sem_wait(done);
+      }
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   printf("%d threads, %.1f ns per create/terminate\n", n, elapsed(&start, &end) / n);
+
+   //Allocations served from the slab free lists instead of malloc
+   t_slab_stats_t st[SLAB_TYPES];
+   int k, slabs = t_slab_stats(st, SLAB_TYPES);
+   for (k = 0; k < slabs; k++) {
+      printf("%-12s %9ld allocs, %9ld reused\n", st[k].name, st[k].allocs, st[k].reused);
+   }
+
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Test Program #18 - Thread Attributes
+ *
+ * Uses t_create_ex() to start many workers on minimum-size stacks, one
+ * named thread on a large stack that needs it, and threads with
+ * automatically assigned ids that take a pointer argument.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "ud_thread.h"
+
+#define TINY 500
+
+sem_t *done;
+int counter = 0;
+
+void tiny_function(void *arg) {
+
+   int *count = (int *) arg;
+   (*count)++;
+   sem_signal(done);
+   t_terminate();
+}
+
+void big_function(void *arg) {
+
+   //Too much for a minimum-size stack
+   char buf[64 * 1024];
+   memset(buf, 'x', sizeof(buf));
+   buf[sizeof(buf) - 1] = '\0';
+   printf("%s used a %d byte buffer\n", (char *) arg, (int) strlen(buf) + 1);
+   sem_signal(done);
+   t_terminate();
+}
+
+int main(void) {
+
+   int i;
+   t_attr_t attr;
+
+   t_init();
+   sem_init(&done, 0);
+
+   t_attr_init(&attr);
+   attr.stack_size = STACK_MIN;
+   for (i = 0; i < TINY; i++) {
+      t_create_ex(tiny_function, &counter, &attr);
+   }
+
+   t_attr_init(&attr);
+   attr.stack_size = 256 * 1024;
+   attr.priority = 0;
+   attr.name = "big";
+   int id = t_create_ex(big_function, "big thread", &attr);
+   printf("big thread has id %d\n", id);
+
+   for (i = 0; i < TINY + 1; i++) {
+      sem_wait(done);
+   }
+   printf("%d tiny threads ran\n", counter);
+
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
+
+/* --- output -----
+big thread has id 1073742325
+big thread used a 65536 byte buffer
+500 tiny threads ran
+*/
@@ -0,0 +1,101 @@
+/*
+ * Test Program #19 - Growable Stacks
+ *
+ * Parks many T_GROWABLE threads, each reserving a 1 MiB stack, while one
+ * of them recurses deeply. Only touched pages should be committed, so the
+ * idle threads cost a few pages each.
+ * Usage: ./test19 [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "ud_thread.h"
+
+#define THREADS 10000
+#define DEPTH 200
+
+sem_t *ready, *gate, *done;
+
+int recurse(int n) {
+
+   //About 1 KiB of stack per level
+   volatile char buf[1024];
+   buf[0] = (char) n;
+   if (n == 0) {
+      return buf[0];
+   }
+   return recurse(n - 1) + buf[0];
+}
+
+void idle_function(void *arg) {
+
+   (void) arg;
+   sem_signal(ready);
+   sem_wait(gate);
+   sem_signal(done);
+   t_terminate();
+}
+
+void deep_function(void *arg) {
+
+   (void) arg;
+   recurse(DEPTH);
+   sem_signal(ready);
+   sem_wait(gate);
+   sem_signal(done);
+   t_terminate();
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, n = THREADS;
+   t_attr_t attr;
+   t_stack_stats_t st;
+
+   if (argc == 2) {
+      n = atoi(argv[1]);
+   }
+
+   t_init();
+   sem_init(&ready, 0);
+   sem_init(&gate, 0);
+   sem_init(&done, 0);
+
+   t_attr_init(&attr);
+   attr.flags = T_GROWABLE;
+   int deep = t_create_ex(deep_function, NULL, &attr);
+   for (i = 1; i < n; i++) {
+      t_create_ex(idle_function, NULL, &attr);
+   }
+
+   //Wait until every thread is parked on the gate
+   for (i = 0; i < n; i++) {
+      sem_wait(ready);
+   }
+
+   t_stack_stats(deep, &st);
+   printf("deep thread: %zu KiB reserved, %zu KiB committed, %zu KiB high water\n",
+          st.reserved / 1024, st.committed / 1024, st.high_water / 1024);
+
+   t_stack_stats(deep + 1, &st);
+   printf("idle thread: %zu KiB reserved, %zu KiB committed, %zu KiB high water\n",
+          st.reserved / 1024, st.committed / 1024, st.high_water / 1024);
+
+   t_stack_stats_total(&st);
+   printf("%d threads: %zu MiB reserved, %zu KiB committed\n",
+          n, st.reserved / (1024 * 1024), st.committed / 1024);
+
+   for (i = 0; i < n; i++) {
+      sem_signal(gate);
+   }
+   for (i = 0; i < n; i++) {
+      sem_wait(done);
+   }
+
+   sem_destroy(&ready);
+   sem_destroy(&gate);
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Test Program #20 - Thread Lookup
+ *
+ * Times block_send() to one thread while many others sit parked, so each
+ * send has to find its receiver among all live threads. Then checks that
+ * the id of a terminated thread stays stale once its slot is reused.
+ * Usage: ./test20 [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define THREADS 20000
+#define SENDS 100000
+
+sem_t *ready, *gate, *done;
+
+double elapsed(struct timespec *start, struct timespec *end) {
+
+   return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+void parked_function(void *arg) {
+
+   (void) arg;
+   sem_signal(ready);
+   sem_wait(gate);
+   sem_signal(done);
+   t_terminate();
+}
+
+void echo_function(void *arg) {
+
+   int i, len, tid;
+   char buf[16];
+
+   (void) arg;
+   for (i = 0; i < SENDS; i++) {
+      tid = 0;
+      receive(&tid, buf, &len);
+   }
+   sem_signal(done);
+   t_terminate();
+}
+
+void short_function(void *arg) {
+
+   (void) arg;
+   sem_signal(done);
+   t_terminate();
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, n = THREADS;
+   struct timespec start, end;
+   t_stack_stats_t st;
+
+   if (argc == 2) {
+      n = atoi(argv[1]);
+   }
+
+   t_init();
+   sem_init(&ready, 0);
+   sem_init(&gate, 0);
+   sem_init(&done, 0);
+
+   for (i = 0; i < n; i++) {
+      t_create_ex(parked_function, NULL, NULL);
+   }
+   for (i = 0; i < n; i++) {
+      sem_wait(ready);
+   }
+
+   int echo = t_create_ex(echo_function, NULL, NULL);
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < SENDS; i++) {
+      block_send(echo, "ping", 4);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   printf("%d parked threads, %.1f ns per block_send\n", n, elapsed(&start, &end) / SENDS);
+   sem_wait(done);
+
+   for (i = 0; i < n; i++) {
+      sem_signal(gate);
+   }
+   for (i = 0; i < n; i++) {
+      sem_wait(done);
+   }
+
+   //The second thread reuses the first one's slot, under a new id
+   t_attr_t attr;
+   t_attr_init(&attr);
+   attr.flags = T_DETACHED;
+   int first = t_create_ex(short_function, NULL, &attr);
+   sem_wait(done);
+   int second = t_create_ex(short_function, NULL, &attr);
+   printf("old id %s, new id %s\n",
+          t_stack_stats(first, &st) == -1 ? "stale" : "live",
+          second != first ? "differs" : "reused");
+   sem_wait(done);
+
+   sem_destroy(&ready);
+   sem_destroy(&gate);
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Test Program #21 - Switch Latency With Many Runnable Threads
+ *
+ * Keeps many threads runnable at once, each yielding in a loop, so every
+ * switch goes to a thread that has not run for a full round and its TCB
+ * and stack have likely left the cache.
+ * Usage: ./test21 [threads] [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define THREADS 10000
+#define ROUNDS 100
+
+int rounds = ROUNDS;
+sem_t *done;
+
+double elapsed(struct timespec *start, struct timespec *end) {
+
+   return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+void thread_function(void *arg) {
+
+   int i;
+
+   (void) arg;
+   for (i = 0; i < rounds; i++) {
+      t_yield();
+   }
+   sem_signal(done);
+   t_terminate();
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, n = THREADS;
+   struct timespec start, end;
+
+   if (argc >= 2) {
+      n = atoi(argv[1]);
+   }
+   if (argc >= 3) {
+      rounds = atoi(argv[2]);
+   }
+
+   t_init();
+   sem_init(&done, 0);
+
+   for (i = 0; i < n; i++) {
+      t_create_ex(thread_function, NULL, NULL);
+   }
+
+   //Main blocks until all are done, leaving only the yielding threads to run
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < n; i++) {
+      sem_wait(done);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   printf("%d threads, %d rounds, %.1f ns per switch\n",
+          n, rounds, elapsed(&start, &end) / ((double) n * rounds));
+
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Test Program #22 - Join and Exit Values
+ *
+ * Computes Fibonacci numbers by fanning out: each thread creates one child
+ * per subproblem, joins both and exits with their sum. Then times a join
+ * on a thread that has already exited against one that is still running.
+ * Last, churns threads nobody joins, detached while running or created by
+ * t_create() under new ids, and checks their TCBs are freed as they exit.
+ * Usage: ./test22 [n]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define N 15
+#define JOINS 100000
+#define CHURN 100000
+
+double elapsed(struct timespec *start, struct timespec *end) {
+
+   return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+void fib_function(void *arg) {
+
+   intptr_t n = (intptr_t) arg;
+   void *a, *b;
+
+   if (n < 2) {
+      t_exit((void *) n);
+   }
+   int left = t_create_ex(fib_function, (void *) (n - 1), NULL);
+   int right = t_create_ex(fib_function, (void *) (n - 2), NULL);
+   t_join(left, &a);
+   t_join(right, &b);
+   t_exit((void *) ((intptr_t) a + (intptr_t) b));
+}
+
+void quick_function(void *arg) {
+
+   t_exit(arg);
+}
+
+void slow_function(void *arg) {
+
+   t_yield();
+   t_exit(arg);
+}
+
+void legacy_function(int val) {
+
+   (void) val;
+   t_terminate();
+}
+
+long live_tcbs(void) {
+
+   t_slab_stats_t st[SLAB_TYPES];
+   int k, slabs = t_slab_stats(st, SLAB_TYPES);
+   for (k = 0; k < slabs; k++) {
+      if (strcmp(st[k].name, "tcb_t") == 0) {
+         return st[k].live;
+      }
+   }
+   return 0;
+}
+
+void report_churn(const char *what, long before) {
+
+   //Up to a batch of exited threads may still wait for the reaper
+   long kept = live_tcbs() - before;
+   printf("%s: %d threads, %s\n", what, CHURN, kept <= REAP_BATCH + 1 ? "freed at exit" : "leaked");
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, n = N;
+   void *value;
+   struct timespec start, end;
+
+   if (argc == 2) {
+      n = atoi(argv[1]);
+   }
+
+   t_init();
+
+   int root = t_create_ex(fib_function, (void *) (intptr_t) n, NULL);
+   t_join(root, &value);
+   printf("fib(%d) = %ld\n", n, (long) (intptr_t) value);
+
+   //A joined thread is gone, and one cannot join itself
+   printf("join again: %d\n", t_join(root, NULL));
+   printf("join self: %d\n", t_join(0, NULL));
+
+   //The child has exited by the time main joins it, so nothing blocks
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < JOINS; i++) {
+      int tid = t_create_ex(quick_function, NULL, NULL);
+      t_yield();
+      t_join(tid, NULL);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   printf("exited child: %.1f ns per create/join\n", elapsed(&start, &end) / JOINS);
+
+   //Main blocks in t_join() until the child comes back round to exit
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < JOINS; i++) {
+      int tid = t_create_ex(slow_function, NULL, NULL);
+      t_join(tid, NULL);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   printf("running child: %.1f ns per create/join\n", elapsed(&start, &end) / JOINS);
+
+   //Detached while still running, so it cannot be joined and is never waited on
+   long before = live_tcbs();
+   int joined = 0;
+   for (i = 0; i < CHURN; i++) {
+      int tid = t_create_ex(slow_function, NULL, NULL);
+      t_yield();
+      t_detach(tid);
+      joined += t_join(tid, NULL) == 0;
+   }
+   t_yield();
+   printf("joined after detach: %d\n", joined);
+   report_churn("detached", before);
+
+   //Legacy threads under ids never used before, that nobody joins
+   before = live_tcbs();
+   for (i = 0; i < CHURN; i++) {
+      t_create(legacy_function, i + 1, 1);
+      t_yield();
+   }
+   report_churn("t_create", before);
+
+   t_shutdown();
+
+   return 0;
+}
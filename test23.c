@@ -0,0 +1,129 @@
+/*
+ * Test Program #23 - Thread Groups
+ *
+ * A "request" starts workers into a group. Some wait on a semaphore that
+ * is never signalled, some wait for mail, some block sending to a thread
+ * that never receives, and some just yield in a loop. Cancelling the group
+ * pulls every one of them out of its wait, and t_group_wait() frees them
+ * all. A second group runs to completion and is waited for normally.
+ */
+
+#include <stdio.h>
+#include "ud_thread.h"
+
+#define WORKERS 200
+
+sem_t *never;
+int sink, finished = 0;
+
+void sem_function(void *arg) {
+
+   (void) arg;
+   sem_wait(never);
+   printf("sem waiter was not cancelled\n");
+}
+
+void mail_function(void *arg) {
+
+   int tid = 0, len;
+   char buf[16];
+
+   (void) arg;
+   receive(&tid, buf, &len);
+   printf("receiver was not cancelled\n");
+}
+
+void send_function(void *arg) {
+
+   block_send(sink, "never read", 10);
+   printf("sender %d was not cancelled\n", *(int *) arg);
+}
+
+void spin_function(void *arg) {
+
+   (void) arg;
+   for (;;) {
+      t_yield();
+   }
+}
+
+void sink_function(void *arg) {
+
+   //Parks without ever reading its mail
+   (void) arg;
+   sem_wait(never);
+}
+
+void work_function(void *arg) {
+
+   (void) arg;
+   t_yield();
+   finished++;
+}
+
+long live_tcbs(void) {
+
+   t_slab_stats_t st[SLAB_TYPES];
+   t_slab_stats(st, SLAB_TYPES);
+   return st[SLAB_TCB].live;
+}
+
+int main(void) {
+
+   int i, n;
+   void *value;
+   t_group_t *request;
+   t_attr_t attr;
+   void (*fns[4])(void *) = { sem_function, mail_function, send_function, spin_function };
+
+   t_init();
+   sem_init(&never, 0);
+   sink = t_create_ex(sink_function, NULL, NULL);
+   long before = live_tcbs();
+
+   t_group_init(&request);
+   t_attr_init(&attr);
+   attr.group = request;
+   for (i = 0; i < WORKERS; i++) {
+      t_create_ex(fns[i % 4], &i, &attr);
+   }
+
+   //Let every worker reach its wait
+   t_yield();
+   t_yield();
+   printf("%ld threads started\n", live_tcbs() - before);
+
+   printf("%d cancelled\n", t_group_cancel(request));
+   printf("%d joined\n", t_group_wait(request));
+   printf("%ld threads left\n", live_tcbs() - before);
+   t_group_destroy(&request);
+
+   //A group that is not cancelled just runs to completion
+   t_group_init(&request);
+   attr.group = request;
+   for (i = 0; i < WORKERS; i++) {
+      t_create_ex(work_function, NULL, &attr);
+   }
+   n = t_group_wait(request);
+   printf("%d joined, %d finished\n", n, finished);
+   t_group_destroy(&request);
+
+   //A single thread can be cancelled too, and exits with T_CANCELED
+   t_cancel(sink);
+   t_join(sink, &value);
+   printf("sink %s\n", value == T_CANCELED ? "cancelled" : "exited");
+
+   sem_destroy(&never);
+   t_shutdown();
+
+   return 0;
+}
+
+/* --- output -----
+200 threads started
+200 cancelled
+200 joined
+0 threads left
+200 joined, 200 finished
+sink cancelled
+*/
@@ -0,0 +1,155 @@
+/*
+ * Test Program #24 - Fair Scheduling Latency
+ *
+ * CPU-bound hogs run next to I/O-bound threads that work for 50 usec, then
+ * block for 1 msec of "I/O". A device thread, round-robin at priority 0,
+ * completes the I/O by signalling each thread's semaphore once it is due.
+ * Reports how late the I/O-bound threads get to run after that, first with
+ * the hogs and I/O-bound threads round-robin, then in the fair class.
+ * Usage: ./test24 [hogs] [msec per run]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define HOGS 4
+#define MAX_HOGS 64
+#define IO_THREADS 4
+#define WORK_NS 50000
+#define IO_NS 1000000
+#define MAX_SAMPLES 100000
+
+int hogs = HOGS;
+long long duration = 1000000000LL;
+volatile int stop;
+long long start_ns;
+long long samples[MAX_SAMPLES];
+int nsamples;
+volatile long spins;
+
+sem_t *io_done[IO_THREADS];
+volatile long long io_due[IO_THREADS];
+
+long long now_ns(void) {
+
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int compare(const void *a, const void *b) {
+
+   long long x = *(const long long *) a, y = *(const long long *) b;
+   return (x > y) - (x < y);
+}
+
+void hog_function(void *arg) {
+
+   (void) arg;
+   while (!stop) {
+      spins++;
+   }
+}
+
+void io_function(void *arg) {
+
+   int id = *(int *) arg;
+
+   while (!stop) {
+      //A short burst of work
+      long long t = now_ns();
+      while (now_ns() - t < WORK_NS);
+
+      //Then block on the I/O, noting how late we run once it is done
+      long long due = now_ns() + IO_NS;
+      io_due[id] = due;
+      sem_wait(io_done[id]);
+      if (nsamples < MAX_SAMPLES) {
+         samples[nsamples++] = now_ns() - due;
+      }
+   }
+}
+
+void device_function(void *arg) {
+
+   int i;
+
+   (void) arg;
+   while (now_ns() - start_ns < duration) {
+      for (i = 0; i < IO_THREADS; i++) {
+         if (io_due[i] != 0 && now_ns() >= io_due[i]) {
+            io_due[i] = 0;
+            sem_signal(io_done[i]);
+         }
+      }
+      t_yield();
+   }
+
+   //Let everyone finish
+   stop = 1;
+   for (i = 0; i < IO_THREADS; i++) {
+      sem_signal(io_done[i]);
+   }
+}
+
+void run(const char *label, int policy) {
+
+   int i, ids[IO_THREADS], tids[MAX_HOGS + IO_THREADS + 1];
+   t_attr_t attr;
+
+   stop = 0;
+   nsamples = 0;
+   spins = 0;
+   start_ns = now_ns();
+   for (i = 0; i < IO_THREADS; i++) {
+      sem_init(&io_done[i], 0);
+      io_due[i] = 0;
+   }
+
+   t_attr_init(&attr);
+   attr.priority = 0;
+   tids[0] = t_create_ex(device_function, NULL, &attr);
+
+   t_attr_init(&attr);
+   attr.policy = policy;
+   for (i = 0; i < hogs; i++) {
+      tids[1 + i] = t_create_ex(hog_function, NULL, &attr);
+   }
+   for (i = 0; i < IO_THREADS; i++) {
+      ids[i] = i;
+      tids[1 + hogs + i] = t_create_ex(io_function, &ids[i], &attr);
+   }
+   for (i = 0; i < 1 + hogs + IO_THREADS; i++) {
+      t_join(tids[i], NULL);
+   }
+   for (i = 0; i < IO_THREADS; i++) {
+      sem_destroy(&io_done[i]);
+   }
+
+   qsort(samples, nsamples, sizeof(long long), compare);
+   printf("%-4s %6d I/Os, late by p50 %6.2f ms, p99 %6.2f ms, max %6.2f ms; %ld M hog spins\n",
+          label, nsamples, samples[nsamples / 2] / 1e6, samples[nsamples * 99 / 100] / 1e6,
+          samples[nsamples - 1] / 1e6, spins / 1000000);
+}
+
+int main(int argc, char *argv[]) {
+
+   if (argc >= 2) {
+      hogs = atoi(argv[1]);
+      if (hogs > MAX_HOGS) {
+         hogs = MAX_HOGS;
+      }
+   }
+   if (argc >= 3) {
+      duration = atoll(argv[2]) * 1000000LL;
+   }
+
+   t_init();
+   run("rr", T_SCHED_RR);
+   run("fair", T_SCHED_FAIR);
+   t_shutdown();
+
+   return 0;
+}
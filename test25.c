@@ -0,0 +1,105 @@
+/*
+ * Test Program #25 - Starvation
+ *
+ * CPU-bound threads at priorities 0, 1 and 2 run side by side, so the
+ * priority 0 threads are a never-ending stream of high priority work.
+ * Each thread notes the longest gap between two of its loop iterations,
+ * its worst wait for the processor. Round-robin leaves the lower levels
+ * waiting for the whole run; under MLFQ aging bounds their wait. Then the
+ * priority 0 threads yield on every iteration, so they never use up a
+ * slice and never sink, and aging has to lift the others above them.
+ * Usage: ./test25 [msec per run]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define LEVELS 3
+#define PER_LEVEL 2
+
+long long duration = 1000000000LL;
+long long start_ns;
+long long worst[LEVELS * PER_LEVEL];
+long loops[LEVELS * PER_LEVEL];
+int yielding;
+
+long long now_ns(void) {
+
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void cpu_function(void *arg) {
+
+   int id = *(int *) arg;
+   long long now, last = start_ns;
+
+   worst[id] = 0;
+   loops[id] = 0;
+   for (;;) {
+      now = now_ns();
+      if (now - last > worst[id]) {
+         worst[id] = now - last;
+      }
+      last = now;
+      loops[id]++;
+      if (now - start_ns > duration) {
+         break;
+      }
+      if (yielding && id < PER_LEVEL) {
+         t_yield();
+      }
+   }
+}
+
+void run(const char *label, int policy, int yield) {
+
+   int i, ids[LEVELS * PER_LEVEL], tids[LEVELS * PER_LEVEL];
+   t_attr_t attr;
+
+   yielding = yield;
+   start_ns = now_ns();
+   for (i = 0; i < LEVELS * PER_LEVEL; i++) {
+      t_attr_init(&attr);
+      attr.policy = policy;
+      attr.priority = i / PER_LEVEL;
+      ids[i] = i;
+      tids[i] = t_create_ex(cpu_function, &ids[i], &attr);
+   }
+   for (i = 0; i < LEVELS * PER_LEVEL; i++) {
+      t_join(tids[i], NULL);
+   }
+
+   for (i = 0; i < LEVELS; i++) {
+      long long w = 0;
+      long n = 0;
+      int j;
+      for (j = 0; j < PER_LEVEL; j++) {
+         if (worst[i * PER_LEVEL + j] > w) {
+            w = worst[i * PER_LEVEL + j];
+         }
+         n += loops[i * PER_LEVEL + j];
+      }
+      printf("%-6s level %d: worst wait %7.1f ms, %5.1f M loops\n", label, i, w / 1e6, n / 1e6);
+   }
+}
+
+int main(int argc, char *argv[]) {
+
+   if (argc == 2) {
+      duration = atoll(argv[1]) * 1000000LL;
+   }
+
+   //Main only blocks in t_join(), it never competes with the others
+   t_init();
+   run("rr", T_SCHED_RR, 0);
+   run("mlfq", T_SCHED_MLFQ, 0);
+   run("rr+y", T_SCHED_RR, 1);
+   run("mlfq+y", T_SCHED_MLFQ, 1);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Test Program #26 - Periodic Real-Time Threads
+ *
+ * Three periodic threads run under EDF next to round-robin CPU hogs:
+ * a 1 msec telemetry flush, a 5 msec control loop, and a 10 msec job
+ * that overruns its 2 msec budget and gets throttled. Reports the jobs,
+ * deadline misses and release jitter of each.
+ * Usage: ./test26 [hogs] [msec]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define HOGS 4
+
+long long duration = 1000000000LL;
+long long start_ns;
+
+long long now_ns(void) {
+
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void busy(long usec) {
+
+   long long t = now_ns();
+   while (now_ns() - t < usec * 1000);
+}
+
+void job_function(void *arg) {
+
+   //Each job does arg usec of work
+   busy((long) arg);
+}
+
+void hog_function(void *arg) {
+
+   (void) arg;
+   while (now_ns() - start_ns < duration);
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, hogs = HOGS, tids[64];
+   t_periodic_stats_t st;
+
+   if (argc >= 2) {
+      hogs = atoi(argv[1]);
+      if (hogs > 64) {
+         hogs = 64;
+      }
+   }
+   if (argc >= 3) {
+      duration = atoll(argv[2]) * 1000000LL;
+   }
+
+   t_init();
+   start_ns = now_ns();
+
+   int periodic[3];
+   const char *names[3] = { "telemetry", "control", "overrun" };
+   periodic[0] = t_create_periodic(job_function, (void *) 100L, 1000, 300, 0);
+   periodic[1] = t_create_periodic(job_function, (void *) 1000L, 5000, 2000, 4000);
+   periodic[2] = t_create_periodic(job_function, (void *) 5000L, 10000, 2000, 0);
+
+   for (i = 0; i < hogs; i++) {
+      tids[i] = t_create_ex(hog_function, NULL, NULL);
+   }
+   for (i = 0; i < hogs; i++) {
+      t_join(tids[i], NULL);
+   }
+
+   for (i = 0; i < 3; i++) {
+      t_periodic_stats(periodic[i], &st);
+      printf("%-9s %5ld jobs, %4ld missed, %4ld throttled, jitter avg %4ld usec, max %5ld usec\n",
+             names[i], st.jobs, st.misses, st.throttled, st.avg_jitter, st.max_jitter);
+      t_cancel(periodic[i]);
+      t_join(periodic[i], NULL);
+   }
+
+   t_shutdown();
+
+   return 0;
+}
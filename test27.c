@@ -0,0 +1,141 @@
+/*
+ * Test Program #27 - Priority Inversion
+ *
+ * The classic three priorities: low takes a lock, high blocks on it, and
+ * CPU-bound medium threads arrive in between. Two of them, as a thread at
+ * the end of its slice gives way to whatever else is ready. With a plain
+ * semaphore the medium threads take turns ahead of low, and high waits for
+ * them; with a mutex from sem_init_mutex() low inherits high's priority
+ * and high waits for little more than low's critical section.
+ * Usage: ./test27 [medium_ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define CRITICAL_MS 20
+#define MEDIUM_MS 200
+#define MEDIUM 2
+
+sem_t *lock, *done;
+long spins_per_ms;
+int medium_ms = MEDIUM_MS;
+double high_wait;
+
+double elapsed(struct timespec *start, struct timespec *end) {
+
+   return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void spin(int ms) {
+
+   //Fixed amount of work, however long the thread is kept off the CPU
+   volatile long i;
+   for (i = 0; i < ms * spins_per_ms; i++) {
+   }
+}
+
+void high_function(void *arg) {
+
+   struct timespec start, end;
+
+   (void) arg;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   sem_wait(lock);
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   high_wait = elapsed(&start, &end);
+   sem_signal(lock);
+   sem_signal(done);
+   t_terminate();
+}
+
+void medium_function(void *arg) {
+
+   (void) arg;
+   spin(medium_ms);
+   sem_signal(done);
+   t_terminate();
+}
+
+void low_function(void *arg) {
+
+   int i;
+   t_attr_t attr;
+
+   (void) arg;
+   sem_wait(lock);
+
+   //High and medium become ready while low is inside; the next tick
+   //switches to high, which then blocks on the lock
+   t_attr_init(&attr);
+   attr.priority = 0;
+   t_create_ex(high_function, NULL, &attr);
+   attr.priority = 1;
+   for (i = 0; i < MEDIUM; i++) {
+      t_create_ex(medium_function, NULL, &attr);
+   }
+   spin(CRITICAL_MS);
+
+   sem_signal(lock);
+   sem_signal(done);
+   t_terminate();
+}
+
+void calibrate() {
+
+   struct timespec start, end;
+   volatile long i;
+   long n = 1000000;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < n; i++) {
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   spins_per_ms = (long) (n / elapsed(&start, &end));
+}
+
+void run(const char *name, int mutex) {
+
+   int i;
+   t_attr_t attr;
+
+   if (mutex) {
+      sem_init_mutex(&lock);
+   }
+   else {
+      sem_init(&lock, 1);
+   }
+
+   t_attr_init(&attr);
+   attr.priority = 2;
+   t_create_ex(low_function, NULL, &attr);
+   for (i = 0; i < MEDIUM + 2; i++) {
+      sem_wait(done);
+   }
+   printf("%-10s high waited %6.1f ms\n", name, high_wait);
+
+   sem_destroy(&lock);
+}
+
+int main(int argc, char *argv[]) {
+
+   if (argc == 2) {
+      medium_ms = atoi(argv[1]);
+   }
+
+   t_init();
+   sem_init(&done, 0);
+   calibrate();
+
+   printf("critical section %d ms, %d medium threads run %d ms each\n",
+          CRITICAL_MS, MEDIUM, medium_ms);
+   run("semaphore", 0);
+   run("mutex", 1);
+
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Test Program #28 - Priority-Ordered Semaphore Wake-Ups
+ *
+ * Batch threads at priority 2 take turns holding a resource for about a
+ * millisecond each, while a request handler at priority 0 keeps asking
+ * for it too. On a FIFO semaphore the handler queues behind every batch
+ * thread; on a SEM_PRIO one it waits only for the current holder.
+ * Usage: ./test28 [batch_threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define BATCH 20
+#define HOLD_US 1000
+#define REQUESTS 200
+
+sem_t *res, *done;
+long spins_per_ms;
+volatile int stop;
+double waits[REQUESTS];
+
+double elapsed(struct timespec *start, struct timespec *end) {
+
+   return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void spin(int us) {
+
+   volatile long i;
+   for (i = 0; i < us * spins_per_ms / 1000; i++) {
+   }
+}
+
+void batch_function(void *arg) {
+
+   (void) arg;
+   while (!stop) {
+      sem_wait(res);
+      spin(HOLD_US);
+      sem_signal(res);
+   }
+   sem_signal(done);
+}
+
+void handler_function(void *arg) {
+
+   int i;
+   struct timespec start, end;
+
+   (void) arg;
+   for (i = 0; i < REQUESTS; i++) {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      sem_wait(res);
+      clock_gettime(CLOCK_MONOTONIC, &end);
+      waits[i] = elapsed(&start, &end);
+      sem_signal(res);
+
+      //Let the batch threads run before the next request
+      t_yield();
+   }
+   sem_signal(done);
+}
+
+int compare(const void *a, const void *b) {
+
+   double x = *(const double *) a, y = *(const double *) b;
+   return (x > y) - (x < y);
+}
+
+void calibrate() {
+
+   struct timespec start, end;
+   volatile long i;
+   long n = 1000000;
+
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < n; i++) {
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   spins_per_ms = (long) (n / elapsed(&start, &end));
+}
+
+void run(const char *name, int order, int batch) {
+
+   int i;
+   t_attr_t attr;
+
+   sem_init_ex(&res, 1, order);
+   stop = 0;
+
+   t_attr_init(&attr);
+   attr.priority = 2;
+   for (i = 0; i < batch; i++) {
+      t_create_ex(batch_function, NULL, &attr);
+   }
+   attr.priority = 0;
+   t_create_ex(handler_function, NULL, &attr);
+
+   sem_wait(done);
+   stop = 1;
+   for (i = 0; i < batch; i++) {
+      sem_wait(done);
+   }
+
+   qsort(waits, REQUESTS, sizeof(double), compare);
+   printf("%-5s handler waited p50 %6.2f ms, p99 %6.2f ms, max %6.2f ms\n", name,
+          waits[REQUESTS / 2], waits[REQUESTS * 99 / 100], waits[REQUESTS - 1]);
+
+   sem_destroy(&res);
+}
+
+int main(int argc, char *argv[]) {
+
+   int batch = BATCH;
+
+   if (argc == 2) {
+      batch = atoi(argv[1]);
+   }
+
+   t_init();
+   sem_init(&done, 0);
+   calibrate();
+
+   printf("%d batch threads holding for %d usec\n", batch, HOLD_US);
+   run("fifo", SEM_FIFO, batch);
+   run("prio", SEM_PRIO, batch);
+
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
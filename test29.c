@@ -0,0 +1,141 @@
+/*
+ * Test Program #29 - Time Slice Control
+ *
+ * Runs CPU-bound threads for a fixed time under different slices, set
+ * globally, per priority and per thread, and counts how often each was
+ * switched out. Then a bursty thread yields after short bursts before one
+ * long one; with t_set_carry() the slice it left unused lets the long
+ * burst run on past a single slice.
+ * Usage: ./test29 [run_ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define HOGS 4
+#define RUN_MS 500
+#define GAP_MS 0.2
+#define BURSTS 20
+#define LONG_MS 40
+
+sem_t *done;
+int run_ms = RUN_MS;
+volatile int stop;
+long switches;
+double longest;
+
+double now() {
+
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+double spin(double ms) {
+
+   //Busy for ms of wall time, returning the longest stretch not switched out
+   double start = now(), last = start, stretch = start, best = 0, t;
+   while ((t = now()) - start < ms) {
+      if (t - last > GAP_MS) {
+         switches++;
+         stretch = t;
+      }
+      if (t - stretch > best) {
+         best = t - stretch;
+      }
+      last = t;
+   }
+   return best;
+}
+
+void hog_function(void *arg) {
+
+   (void) arg;
+   spin(run_ms);
+   sem_signal(done);
+}
+
+void rival_function(void *arg) {
+
+   (void) arg;
+   while (!stop) {
+      spin(1);
+   }
+   sem_signal(done);
+}
+
+void bursty_function(void *arg) {
+
+   int i;
+
+   (void) arg;
+   for (i = 0; i < BURSTS; i++) {
+      spin(1);
+      t_yield();
+   }
+   longest = spin(LONG_MS);
+   stop = 1;
+   sem_signal(done);
+}
+
+void hogs(const char *name, long quantum) {
+
+   int i;
+   int tids[HOGS];
+
+   switches = 0;
+   for (i = 0; i < HOGS; i++) {
+      tids[i] = t_create_ex(hog_function, NULL, NULL);
+      if (quantum > 0) {
+         t_set_quantum(tids[i], quantum);
+      }
+   }
+   for (i = 0; i < HOGS; i++) {
+      sem_wait(done);
+   }
+   printf("%-24s %6.0f switches/s\n", name, switches * 1000.0 / run_ms);
+}
+
+void bursty(const char *name, long carry) {
+
+   t_attr_t attr;
+
+   //The bursts race a thread that never yields
+   stop = 0;
+   t_attr_init(&attr);
+   int tid = t_create_ex(bursty_function, NULL, &attr);
+   t_set_carry(tid, carry);
+   t_create_ex(rival_function, NULL, &attr);
+   sem_wait(done);
+   sem_wait(done);
+   printf("%-24s longest run %4.0f ms of a %d ms burst\n", name, longest, LONG_MS);
+}
+
+int main(int argc, char *argv[]) {
+
+   if (argc == 2) {
+      run_ms = atoi(argv[1]);
+   }
+
+   t_init();
+   sem_init(&done, 0);
+
+   hogs("default 10 ms", 0);
+   t_set_default_quantum(2000);
+   hogs("default 2 ms", 0);
+   t_set_priority_quantum(1, 50000);
+   hogs("priority 1 at 50 ms", 0);
+   hogs("t_set_quantum 1 ms", 1000);
+   t_set_priority_quantum(1, 0);
+   t_set_default_quantum(10000);
+
+   bursty("no carry", 0);
+   bursty("carry up to 20 ms", 20000);
+
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Test Program #30 - Idle Parking and Deadlock
+ *
+ * With four workers and a single periodic thread, every worker is idle
+ * between releases; they should sleep rather than spin, so the process
+ * uses a small fraction of one core. Then a child process takes two
+ * mutexes in opposite orders on two threads, and should exit with the
+ * "all threads deadlocked" diagnostic. Last, children whose threads all
+ * finish, main with t_terminate(), on one worker and on several, should
+ * exit cleanly with no diagnostic.
+ * Usage: ./test30 [workers]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "ud_thread.h"
+
+#define WORKERS 4
+#define PERIOD 50000
+#define JOBS 10
+
+sem_t *done, *first, *second;
+
+double ms(clockid_t clock) {
+
+   struct timespec t;
+   clock_gettime(clock, &t);
+   return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+void tick_function(void *arg) {
+
+   (void) arg;
+   sem_signal(done);
+}
+
+void reverse_function(void *arg) {
+
+   (void) arg;
+   sem_wait(second);
+   t_yield();
+   sem_wait(first);
+}
+
+void deadlock() {
+
+   t_attr_t attr;
+
+   t_init();
+   sem_init_mutex(&first);
+   sem_init_mutex(&second);
+
+   sem_wait(first);
+   t_attr_init(&attr);
+   attr.name = "reverse";
+   t_create_ex(reverse_function, NULL, &attr);
+   t_yield();
+   sem_wait(second);
+
+   printf("not deadlocked\n");
+   exit(EXIT_SUCCESS);
+}
+
+void last_function(void *arg) {
+
+   (void) arg;
+   t_yield();
+}
+
+void finish(int workers) {
+
+   //Main goes first, the other thread is the last one left when it ends
+   t_init_workers(workers);
+   t_create_ex(last_function, NULL, NULL);
+   t_terminate();
+   exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[]) {
+
+   int i, status, n = WORKERS;
+
+   if (argc == 2) {
+      n = atoi(argv[1]);
+   }
+
+   t_init_workers(n);
+   sem_init(&done, 0);
+
+   double wall = ms(CLOCK_MONOTONIC), cpu = ms(CLOCK_PROCESS_CPUTIME_ID);
+   int tid = t_create_periodic(tick_function, NULL, PERIOD, PERIOD, 0);
+   for (i = 0; i < JOBS; i++) {
+      sem_wait(done);
+   }
+   wall = ms(CLOCK_MONOTONIC) - wall;
+   cpu = ms(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+   printf("%d workers idle for %.0f ms used %.1f ms of CPU\n", n, wall, cpu);
+
+   t_cancel(tid);
+   t_join(tid, NULL);
+   sem_destroy(&done);
+   t_shutdown();
+
+   //The diagnostic goes to the child's stderr
+   fflush(stdout);
+   if (fork() == 0) {
+      deadlock();
+   }
+   wait(&status);
+   printf("deadlocked child exited with status %d\n", WEXITSTATUS(status));
+
+   int counts[2] = { 1, n };
+   for (i = 0; i < 2; i++) {
+      fflush(stdout);
+      if (fork() == 0) {
+         finish(counts[i]);
+      }
+      wait(&status);
+      printf("finished child on %d worker%s exited with status %d\n", counts[i], counts[i] == 1 ? "" : "s",
+             WEXITSTATUS(status));
+   }
+
+   return 0;
+}
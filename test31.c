@@ -0,0 +1,166 @@
+/*
+ * Test Program #31 - Wait-For Cycle Detection
+ *
+ * Five philosophers each take their left fork and then wait for their
+ * right one, while the main thread keeps running; t_deadlock_check()
+ * finds the cycle of five. Then two threads block_send() to each other,
+ * and the detector running from the tick reports that cycle of two.
+ * Last, times a check over a long chain of joins, which has no cycle.
+ * Usage: ./test31 [chain_threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define PHILOSOPHERS 5
+#define CHAIN 10000
+#define CHECKS 100
+
+sem_t *forks[PHILOSOPHERS], *gate;
+int phils[PHILOSOPHERS], pair[2], *chain;
+volatile int reported;
+int report_tids[T_DEADLOCK_MAX];
+
+double elapsed(struct timespec *start, struct timespec *end) {
+
+   return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+void philosopher(void *arg) {
+
+   long i = (long) arg;
+   sem_wait(forks[i]);
+   t_yield();
+   sem_wait(forks[(i + 1) % PHILOSOPHERS]);
+}
+
+void sender(void *arg) {
+
+   long i = (long) arg;
+   t_yield();
+   block_send(pair[1 - i], "hello", 5);
+}
+
+void link_function(void *arg) {
+
+   long i = (long) arg;
+   if (i == 0) {
+      sem_wait(gate);
+   }
+   else {
+      t_join(chain[i - 1], NULL);
+   }
+}
+
+void report(const int *tids, int n) {
+
+   int i;
+   for (i = 0; i < n; i++) {
+      report_tids[i] = tids[i];
+   }
+   reported = n;
+}
+
+int index_of(int tid, int *tids, int n) {
+
+   int i;
+   for (i = 0; i < n; i++) {
+      if (tids[i] == tid) {
+         return i;
+      }
+   }
+   return -1;
+}
+
+void print_cycle(const char *what, const int *cycle, int n, int *tids, int count) {
+
+   //Rotate the cycle to start at the lowest index, it may be found anywhere
+   int i, first = 0;
+   for (i = 1; i < n; i++) {
+      if (index_of(cycle[i], tids, count) < index_of(cycle[first], tids, count)) {
+         first = i;
+      }
+   }
+   printf("%s cycle of %d:", what, n);
+   for (i = 0; i < n; i++) {
+      printf(" %d ->", index_of(cycle[(first + i) % n], tids, count));
+   }
+   printf(" %d\n", index_of(cycle[first], tids, count));
+}
+
+int main(int argc, char *argv[]) {
+
+   long i;
+   int n = CHAIN, cycle[T_DEADLOCK_MAX];
+   struct timespec start, end;
+
+   if (argc == 2) {
+      n = atoi(argv[1]);
+   }
+
+   t_init();
+
+   for (i = 0; i < PHILOSOPHERS; i++) {
+      sem_init(&forks[i], 1);
+   }
+   for (i = 0; i < PHILOSOPHERS; i++) {
+      phils[i] = t_create_ex(philosopher, (void *) i, NULL);
+   }
+   printf("before: %d\n", t_deadlock_check(cycle, T_DEADLOCK_MAX));
+   int len = 0;
+   for (i = 0; i < 1000 && len == 0; i++) {
+      t_yield();
+      len = t_deadlock_check(cycle, T_DEADLOCK_MAX);
+   }
+   print_cycle("philosophers", cycle, len, phils, PHILOSOPHERS);
+
+   //Reported once from the tick, not again on later checks
+   t_deadlock_detect(1000, report);
+   for (i = 0; i < 2; i++) {
+      pair[i] = t_create_ex(sender, (void *) i, NULL);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   do {
+      t_yield();
+      clock_gettime(CLOCK_MONOTONIC, &end);
+   } while (elapsed(&start, &end) < 50000);
+   t_deadlock_detect(0, NULL);
+   print_cycle("reported", report_tids, reported, pair, 2);
+
+   for (i = 0; i < PHILOSOPHERS; i++) {
+      t_cancel(phils[i]);
+      t_join(phils[i], NULL);
+   }
+   for (i = 0; i < 2; i++) {
+      t_cancel(pair[i]);
+      t_join(pair[i], NULL);
+   }
+
+   //A chain of joins ending at a semaphore is no cycle, however long
+   sem_init(&gate, 0);
+   chain = malloc(n * sizeof(int));
+   for (i = 0; i < n; i++) {
+      chain[i] = t_create_ex(link_function, (void *) i, NULL);
+   }
+   t_yield();
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < CHECKS; i++) {
+      len = t_deadlock_check(cycle, T_DEADLOCK_MAX);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   printf("%d blocked threads: %d in a cycle, %.0f usec per check\n", n, len,
+          elapsed(&start, &end) / CHECKS);
+
+   sem_signal(gate);
+   t_join(chain[n - 1], NULL);
+   free(chain);
+   sem_destroy(&gate);
+   for (i = 0; i < PHILOSOPHERS; i++) {
+      sem_destroy(&forks[i]);
+   }
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * Test Program #32 - Waiting on Several Semaphores
+ *
+ * Dining philosophers that hold their forks across a yield, so neighbours
+ * contend: taking the lower-numbered fork first and then the other, one
+ * sem_wait() at a time, against sem_wait_all() on both. Then a server
+ * takes requests from three queues with sem_wait_any(), and reports how
+ * many it got from each, and what a cancelled waiter left behind. Then
+ * t_deadlock_check() finds a cycle through a thread in sem_wait_any().
+ * Last, sem_wait_all() refuses a set naming the same semaphore twice.
+ * Usage: ./test32 [meals]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define PHILOSOPHERS 5
+#define MEALS 20000
+#define QUEUES 3
+#define REQUESTS 1000
+
+sem_t *forks[PHILOSOPHERS], *done, *queues[QUEUES], *held[3], *ready;
+int meals = MEALS, use_all;
+
+double elapsed(struct timespec *start, struct timespec *end) {
+
+   return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+void philosopher(void *arg) {
+
+   long id = (long) arg;
+   int i, left = id, right = (id + 1) % PHILOSOPHERS;
+   sem_t *pair[2];
+
+   pair[0] = forks[left < right ? left : right];
+   pair[1] = forks[left < right ? right : left];
+   for (i = 0; i < meals; i++) {
+      if (use_all) {
+         sem_wait_all(pair, 2);
+      }
+      else {
+         sem_wait(pair[0]);
+         sem_wait(pair[1]);
+      }
+      t_yield();
+      sem_signal(pair[0]);
+      sem_signal(pair[1]);
+      t_yield();
+   }
+   sem_signal(done);
+}
+
+void dine(const char *name, int all) {
+
+   long i;
+   struct timespec start, end;
+
+   use_all = all;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   for (i = 0; i < PHILOSOPHERS; i++) {
+      t_create_ex(philosopher, (void *) i, NULL);
+   }
+   for (i = 0; i < PHILOSOPHERS; i++) {
+      sem_wait(done);
+   }
+   clock_gettime(CLOCK_MONOTONIC, &end);
+   printf("%-12s %5.0f meals/ms\n", name, PHILOSOPHERS * meals / elapsed(&start, &end));
+}
+
+void client(void *arg) {
+
+   long q = (long) arg;
+   int i;
+   for (i = 0; i < REQUESTS * (q + 1); i++) {
+      sem_signal(queues[q]);
+      t_yield();
+   }
+}
+
+void server(void *arg) {
+
+   int i, index, got[QUEUES] = { 0 };
+
+   (void) arg;
+   for (i = 0; i < REQUESTS * (1 + 2 + 3); i++) {
+      sem_wait_any(queues, QUEUES, &index);
+      got[index]++;
+   }
+   printf("server got");
+   for (i = 0; i < QUEUES; i++) {
+      printf(" %d", got[i]);
+   }
+   printf(" from %d queues\n", QUEUES);
+   sem_signal(done);
+}
+
+void stuck(void *arg) {
+
+   int index;
+
+   (void) arg;
+   sem_wait_any(queues, QUEUES, &index);
+   printf("stuck waiter woke\n");
+}
+
+void any_holder(void *arg) {
+
+   int index;
+   sem_t *others[2] = { held[1], held[2] };
+
+   (void) arg;
+   sem_wait(held[0]);
+   sem_signal(done);
+   sem_wait(ready);
+   sem_wait_any(others, 2, &index);
+}
+
+void all_holder(void *arg) {
+
+   (void) arg;
+   sem_wait_all(&held[1], 2);
+   sem_signal(ready);
+   sem_wait(held[0]);
+}
+
+int main(int argc, char *argv[]) {
+
+   long i;
+
+   if (argc == 2) {
+      meals = atoi(argv[1]);
+   }
+
+   t_init();
+   sem_init(&done, 0);
+   for (i = 0; i < PHILOSOPHERS; i++) {
+      sem_init(&forks[i], 1);
+   }
+
+   dine("one by one", 0);
+   dine("sem_wait_all", 1);
+
+   for (i = 0; i < QUEUES; i++) {
+      sem_init(&queues[i], 0);
+   }
+   t_create_ex(server, NULL, NULL);
+   for (i = 0; i < QUEUES; i++) {
+      t_create_ex(client, (void *) i, NULL);
+   }
+   sem_wait(done);
+
+   //A cancelled waiter leaves no stand-ins, so a signal is still there to take
+   int tid = t_create_ex(stuck, NULL, NULL);
+   t_yield();
+   t_cancel(tid);
+   t_join(tid, NULL);
+   sem_signal(queues[1]);
+   int index;
+   sem_wait_any(queues, QUEUES, &index);
+   printf("after cancel, took from queue %d\n", index);
+
+   //One thread holds both semaphores the other waits for, so the wait is a cycle
+   int cycle[T_DEADLOCK_MAX], pair[2];
+   for (i = 0; i < 3; i++) {
+      sem_init(&held[i], 1);
+   }
+   sem_init(&ready, 0);
+   pair[0] = t_create_ex(any_holder, NULL, NULL);
+   sem_wait(done);
+   pair[1] = t_create_ex(all_holder, NULL, NULL);
+   int len = 0;
+   struct timespec start, now;
+   clock_gettime(CLOCK_MONOTONIC, &start);
+   do {
+      t_yield();
+      len = t_deadlock_check(cycle, T_DEADLOCK_MAX);
+      clock_gettime(CLOCK_MONOTONIC, &now);
+   } while (len == 0 && elapsed(&start, &now) < 1000);
+   printf("sem_wait_any in a cycle of %d\n", len);
+   for (i = 0; i < 2; i++) {
+      t_cancel(pair[i]);
+      t_join(pair[i], NULL);
+   }
+
+   //Twice the same fork would wait on itself, so nothing is taken
+   sem_t *twice[2] = { forks[0], forks[0] };
+   int r = sem_wait_all(twice, 2);
+   printf("same semaphore twice: %d, then sem_wait_all on a pair: %d\n", r, sem_wait_all(forks, 2));
+   sem_signal(forks[0]);
+   sem_signal(forks[1]);
+
+   for (i = 0; i < 3; i++) {
+      sem_destroy(&held[i]);
+   }
+   sem_destroy(&ready);
+   for (i = 0; i < QUEUES; i++) {
+      sem_destroy(&queues[i]);
+   }
+   for (i = 0; i < PHILOSOPHERS; i++) {
+      sem_destroy(&forks[i]);
+   }
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Test Program #33 - Direct Handoff
+ *
+ * A client and a server ping-pong over two semaphores while CPU-bound
+ * threads keep the ready queues full. Normally each woken thread waits
+ * behind every hog, so a round trip takes a slice per hog; with
+ * t_set_handoff() the signaller switches straight to the thread it woke.
+ * Then t_yield_to() picks one thread out of several ready ones, and
+ * send() to threads that are ready already leaves them in turn.
+ * Usage: ./test33 [hogs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define HOGS 4
+#define ROUNDS 50
+#define QUANTUM 1000
+
+sem_t *ping, *pong, *done;
+volatile int stop;
+double trips[ROUNDS];
+
+double now() {
+
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec * 1e6 + t.tv_nsec / 1e3;
+}
+
+void hog(void *arg) {
+
+   (void) arg;
+   while (!stop) {
+   }
+   sem_signal(done);
+}
+
+void server(void *arg) {
+
+   int i;
+
+   (void) arg;
+   for (i = 0; i < ROUNDS; i++) {
+      sem_wait(ping);
+      sem_signal(pong);
+   }
+   sem_signal(done);
+}
+
+int compare(const void *a, const void *b) {
+
+   double x = *(const double *) a, y = *(const double *) b;
+   return (x > y) - (x < y);
+}
+
+void run(const char *name, int hogs, int on) {
+
+   int i;
+   double start;
+
+   t_set_handoff(on);
+   stop = 0;
+   for (i = 0; i < hogs; i++) {
+      t_create_ex(hog, NULL, NULL);
+   }
+   t_create_ex(server, NULL, NULL);
+   for (i = 0; i < ROUNDS; i++) {
+      start = now();
+      sem_signal(ping);
+      sem_wait(pong);
+      trips[i] = now() - start;
+   }
+   stop = 1;
+   for (i = 0; i < hogs + 1; i++) {
+      sem_wait(done);
+   }
+   t_set_handoff(0);
+
+   qsort(trips, ROUNDS, sizeof(double), compare);
+   printf("%-8s %d hogs: round trip p50 %8.1f usec, max %8.1f usec\n", name, hogs,
+          trips[ROUNDS / 2], trips[ROUNDS - 1]);
+}
+
+void named(void *arg) {
+
+   printf("%s ", (char *) arg);
+}
+
+void reader(void *arg) {
+
+   int tid, len;
+   char msg[8];
+
+   receive(&tid, msg, &len);
+   printf("%ld ", (long) arg);
+   sem_signal(done);
+}
+
+int main(int argc, char *argv[]) {
+
+   int hogs = HOGS;
+
+   if (argc == 2) {
+      hogs = atoi(argv[1]);
+   }
+
+   t_init();
+   t_set_default_quantum(QUANTUM);
+   sem_init(&ping, 0);
+   sem_init(&pong, 0);
+   sem_init(&done, 0);
+
+   run("queued", 0, 0);
+   run("queued", hogs, 0);
+   run("handoff", hogs, 1);
+
+   //Three ready threads, and the last one created goes ahead of the others
+   t_create_ex(named, "first", NULL);
+   t_create_ex(named, "second", NULL);
+   int tid = t_create_ex(named, "third", NULL);
+   printf("yield_to: ");
+   int r = t_yield_to(tid);
+   t_yield();
+   printf("(returned %d, then %d for a finished thread)\n", r, t_yield_to(tid));
+
+   //Nobody waits in receive() yet, so no send() wakes a thread to switch to
+   long i;
+   int readers[4], order[4] = { 1, 0, 3, 2 };
+   for (i = 0; i < 4; i++) {
+      readers[i] = t_create_ex(reader, (void *) (i + 1), NULL);
+   }
+   t_set_handoff(1);
+   printf("send to 2 1 4 3, run: ");
+   for (i = 0; i < 4; i++) {
+      send(readers[order[i]], "hi", 3);
+   }
+   for (i = 0; i < 4; i++) {
+      sem_wait(done);
+   }
+   t_set_handoff(0);
+   printf("\n");
+
+   sem_destroy(&ping);
+   sem_destroy(&pong);
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Test Program #34 - Fresh Slice After Blocking
+ *
+ * A thread runs most of its slice, blocks on a semaphore, and is woken by
+ * a CPU-bound thread that keeps running. Once back on the processor it
+ * times how long it runs before it is preempted: a thread that blocked
+ * starts a whole new slice, not the few ticks left of the old one.
+ * Usage: ./test34 [rounds, up to 11]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ud_thread.h"
+
+#define QUANTUM 10000
+#define BEFORE 8000
+#define GAP 500
+#define ROUNDS 11
+
+sem_t *gate, *done;
+volatile int waiting, stop;
+int rounds = ROUNDS;
+long long runs[ROUNDS];
+
+long long now_us(void) {
+
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+long long spin_until_preempted(long long limit) {
+
+   //Run until the clock jumps, as another thread ran, or limit usec pass
+   long long start = now_us(), last = start, now;
+   for (;;) {
+      now = now_us();
+      if (now - last > GAP || now - start > limit) {
+         return last - start;
+      }
+      last = now;
+   }
+}
+
+int compare(const void *a, const void *b) {
+
+   long long x = *(const long long *) a, y = *(const long long *) b;
+   return (x > y) - (x < y);
+}
+
+void hog(void *arg) {
+
+   (void) arg;
+   while (!stop) {
+      if (waiting) {
+         waiting = 0;
+         sem_signal(gate);
+      }
+   }
+   sem_signal(done);
+}
+
+void blocker(void *arg) {
+
+   int i;
+
+   (void) arg;
+   for (i = 0; i < rounds; i++) {
+      //Back from preemption on a fresh slice, use most of it, then block
+      spin_until_preempted(4 * QUANTUM);
+      long long start = now_us();
+      while (now_us() - start < BEFORE) {
+      }
+      waiting = 1;
+      sem_wait(gate);
+
+      runs[i] = spin_until_preempted(4 * QUANTUM);
+   }
+
+   //The median, as the host may take the processor away now and then
+   qsort(runs, rounds, sizeof(long long), compare);
+   printf("after blocking: median run %s a %d usec slice\n",
+          runs[rounds / 2] > QUANTUM / 2 ? "close to" : "well short of", QUANTUM);
+   stop = 1;
+   sem_signal(done);
+}
+
+int main(int argc, char *argv[]) {
+
+   if (argc == 2 && atoi(argv[1]) > 0 && atoi(argv[1]) <= ROUNDS) {
+      rounds = atoi(argv[1]);
+   }
+
+   t_init();
+   t_set_default_quantum(QUANTUM);
+   sem_init(&gate, 0);
+   sem_init(&done, 0);
+
+   t_create_ex(hog, NULL, NULL);
+   t_create_ex(blocker, NULL, NULL);
+   sem_wait(done);
+   sem_wait(done);
+
+   sem_destroy(&gate);
+   sem_destroy(&done);
+   t_shutdown();
+
+   return 0;
+}